@@ -86,7 +86,7 @@ public:
 
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   template<typename T, typename... A>
-  auto &add(A... a)
+  auto &add(A&&... a)
   {
     auto &tmp = m_shape.emplace_back(std::make_unique<T>(std::forward<A>(a)...));
     return * static_cast<T*>(tmp.get());
@@ -0,0 +1,399 @@
+/*
+clang++ -std=c++20 shape10.cc \
+
+  Add the SFML flags from shape7.cc to include shape7/shape8 in the
+  footprint report.
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <optional>
+#include <stdexcept>
+#include <cstdint>
+
+
+//=========================================================
+// Every shape is packed into 8 bytes: 16-bit coordinates, a 16-bit size
+// and a word holding the 2-bit type tag and a 14-bit second size.
+// A nested drawing stores the index of its record list instead. Values
+// that do not fit are rejected rather than truncated.
+class Packed {
+public:
+
+  enum Tag : std::uint16_t { circle, triangle, rectangle, drawing };
+
+  static Packed make(Tag t, int x, int y, int a, int b = 0)
+  {
+    if (a < 0 || a > 0xffff || b < 0 || b > 0x3fff)
+      throw std::out_of_range("Packed: size out of range");
+    return Packed(narrow(x), narrow(y), std::uint16_t(a),
+      std::uint16_t(t << 14 | b));
+  }
+
+  static Packed make_drawing(std::uint32_t index)
+  {
+    if (index > 0x3fffffff)
+      throw std::out_of_range("Packed: too many drawings");
+    return Packed(0, 0, std::uint16_t(index),
+      std::uint16_t(drawing << 14 | index >> 16));
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Tag tag() const { return Tag(m_b >> 14); }
+  int x() const { return m_x; }
+  int y() const { return m_y; }
+  int a() const { return m_a; }
+  int b() const { return m_b & 0x3fff; }
+  std::uint32_t index() const { return std::uint32_t(b()) << 16 | m_a; }
+
+//---------------------------------------------------------
+private:
+  Packed(std::int16_t x, std::int16_t y, std::uint16_t a, std::uint16_t b)
+    : m_x(x), m_y(y), m_a(a), m_b(b) {}
+
+  static std::int16_t narrow(int v)
+  {
+    if (v < INT16_MIN || v > INT16_MAX)
+      throw std::out_of_range("Packed: coordinate out of range");
+    return std::int16_t(v);
+  }
+
+  std::int16_t m_x, m_y;
+  std::uint16_t m_a, m_b;
+};
+
+static_assert(sizeof(Packed) == 8);
+
+
+//=========================================================
+// Circle, Triangle and Rectangle are views of a packed record with the
+// same accessors as the shapes in shape6.cc.
+class Circle {
+public:
+
+  Circle(const Packed &p) : m_p(&p) {}
+  static Packed pack(int x, int y, int radius)
+  {
+    return Packed::make(Packed::circle, x, y, radius);
+  }
+
+  std::tuple<int, int> getPosition() const { return {m_p->x(), m_p->y()}; }
+  int getSize() const { return m_p->a(); }
+
+//---------------------------------------------------------
+private:
+  const Packed *m_p;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(const Packed &p) : m_p(&p) {}
+  static Packed pack(int x, int y, int len)
+  {
+    return Packed::make(Packed::triangle, x, y, len);
+  }
+
+  std::tuple<int, int> getPosition() const { return {m_p->x(), m_p->y()}; }
+  int getSize() const { return m_p->a(); }
+
+//---------------------------------------------------------
+private:
+  const Packed *m_p;
+};
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(const Packed &p) : m_p(&p) {}
+  static Packed pack(int x, int y, int w, int h)
+  {
+    return Packed::make(Packed::rectangle, x, y, w, h);
+  }
+
+  std::tuple<int, int> getPosition() const { return {m_p->x(), m_p->y()}; }
+  std::tuple<int, int> getSize() const { return {m_p->a(), m_p->b()}; }
+
+//---------------------------------------------------------
+private:
+  const Packed *m_p;
+};
+
+
+//=========================================================
+// A document owns one record list per drawing; a Drawing is a handle to
+// one of them.
+class Document;
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+class Drawing {
+public:
+
+  Drawing(Document &doc, std::uint32_t index) : m_doc(&doc), m_index(index) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Adding a Drawing returns a handle to it, which stays valid. Adding a
+  // leaf returns its index: a view would point into the record list, which
+  // the next add() may move.
+  template<typename T, typename... A>
+  auto add(A&&... a);
+
+  // A view of shape i, valid until the next add() to this drawing.
+  Shape operator[](std::size_t i) const;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  class iterator;
+  iterator begin() const;
+  iterator end() const;
+
+//---------------------------------------------------------
+private:
+  std::vector<Packed> &records() const;
+
+  Document *m_doc;
+  std::uint32_t m_index;
+};
+
+
+//=========================================================
+class Document {
+public:
+
+  Document() : m_drawing(1) {}
+
+  Drawing root() { return Drawing(*this, 0); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::uint32_t make_drawing()
+  {
+    m_drawing.emplace_back();
+    return std::uint32_t(m_drawing.size() - 1);
+  }
+
+  std::vector<Packed> &operator[](std::uint32_t i) { return m_drawing[i]; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::size_t size() const
+  {
+    std::size_t n = 0;
+    for (auto &d : m_drawing) n += d.size();
+    return n;
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<std::vector<Packed>> m_drawing;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+inline std::vector<Packed> &Drawing::records() const
+{
+  return (*m_doc)[m_index];
+}
+
+template<typename T, typename... A>
+auto Drawing::add(A&&... a)
+{
+  if constexpr (std::is_same_v<T, Drawing>)
+  {
+    auto index = m_doc->make_drawing();
+    records().push_back(Packed::make_drawing(index));
+    return Drawing(*m_doc, index);
+  }
+  else
+  {
+    records().push_back(T::pack(std::forward<A>(a)...));
+    return records().size() - 1;
+  }
+}
+
+
+//=========================================================
+// Dereferencing unpacks the tag into the matching view.
+class Drawing::iterator {
+public:
+
+  iterator(const Drawing &d, std::size_t i) : m_d(d), m_i(i) {}
+
+  Shape &operator*() { return m_current.emplace(m_d[m_i]); }
+
+  iterator &operator++() { ++m_i; return *this; }
+  bool operator!=(const iterator &o) const { return m_i != o.m_i; }
+
+//---------------------------------------------------------
+private:
+  Drawing m_d;
+  std::size_t m_i;
+  std::optional<Shape> m_current;
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+inline Shape Drawing::operator[](std::size_t i) const
+{
+  auto &p = records()[i];
+  switch (p.tag())
+  {
+    case Packed::circle: return Circle(p);
+    case Packed::triangle: return Triangle(p);
+    case Packed::rectangle: return Rectangle(p);
+    default: return Drawing(*m_doc, p.index());
+  }
+}
+
+inline Drawing::iterator Drawing::begin() const { return {*this, 0}; }
+inline Drawing::iterator Drawing::end() const { return {*this, records().size()}; }
+
+
+
+//=========================================================
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    const char *p = "";
+    const char *postfix = ",\n";
+
+    m_os << "\"drawing\": [\n";
+    for (auto &s : d)
+    {
+      m_os << p;
+      std::visit(*this, s);
+      p = postfix;
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+
+//=========================================================
+// Bytes per shape in each of the earlier examples. The classes are
+// re-declared with the same members so their sizes can be taken here.
+#if __has_include(<SFML/Graphics.hpp>)
+#include <SFML/Graphics.hpp>
+#define HAVE_SFML 1
+#endif
+
+struct VirtualRectangle {              // shape1.cc - shape4.cc
+  virtual ~VirtualRectangle() {}
+  int m_x, m_y, m_w, m_h;
+};
+
+struct PlainCircle { int m_x, m_y, m_radius; };
+struct PlainRectangle { int m_x, m_y, m_w, m_h; };
+struct PlainDrawing { std::vector<int> m_shape; };
+
+void footprint(std::ostream &os)
+{
+  // A heap block carries at least one word of allocator bookkeeping and
+  // is rounded up to 16 bytes.
+  auto heap = [](std::size_t n) { return (n + sizeof(void*) + 15) / 16 * 16; };
+
+  auto row = [&](const char *name, std::size_t bytes) {
+    os << std::setw(28) << std::left << name << std::setw(4) << std::right
+       << bytes << " bytes/shape, " << std::setprecision(2) << 64.0 / bytes
+       << " per cache line\n";
+  };
+
+  row("shape1-4  unique_ptr<Shape>",
+    sizeof(std::unique_ptr<VirtualRectangle>) + heap(sizeof(VirtualRectangle)));
+  row("shape5-6  std::variant",
+    sizeof(std::variant<PlainCircle, PlainCircle, PlainRectangle, PlainDrawing>));
+
+#ifdef HAVE_SFML
+  struct SfDrawing { std::vector<int> m_shape; };
+  row("shape7-8  std::variant (SFML)",
+    sizeof(std::variant<sf::CircleShape, sf::CircleShape, sf::RectangleShape,
+      SfDrawing>));
+#else
+  os << std::setw(28) << std::left << "shape7-8  std::variant (SFML)"
+     << "   n/a (compile with SFML)\n";
+#endif
+
+  row("shape10   Packed", sizeof(Packed));
+}
+
+
+//=========================================================
+int main()
+{
+  Document doc;
+  auto d = doc.root();
+  d.add<Circle>(100, 100, 50);
+
+  d.add<Triangle>(100, 200, 40);
+
+  auto d1 = d.add<Drawing>();
+  d1.add<Rectangle>(50, 50, 25, 50);
+  d1.add<Rectangle>(75, 75, 25, 50);
+
+  auto d2 = d1.add<Drawing>();
+  d2.add<Rectangle>(50, 150, 25, 60);
+  d2.add<Rectangle>(75, 175, 25, 60);
+
+  // Does not fit in 16 bits: nothing is added.
+  try { d.add<Circle>(40000, 0, 5); }
+  catch (const std::out_of_range &e) { std::cout << e.what() << "\n\n"; }
+
+  ToJSON json(std::cout);
+  json(d);
+
+  std::cout << '\n';
+  footprint(std::cout);
+
+  return 0;
+}
@@ -0,0 +1,519 @@
+/*
+clang++ -std=c++20 -O2 shape11.cc \
+*/
+
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <chrono>
+#include <cassert>
+
+
+//=========================================================
+class Indenter {
+public:
+
+  Indenter(int num_space = 2) : m_num_space(num_space)
+  {
+    m_ilevel += m_num_space;
+  }
+
+  ~Indenter()
+  {
+    m_ilevel -= m_num_space;
+    if (m_ilevel < 0)
+      m_ilevel = 0;
+  }
+
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  friend std::ostream& operator<<(std::ostream &os, const Indenter &ind)
+  {
+    for (int i = 0; i < ind.m_ilevel; ++i)
+      os << ' ';
+    return os;
+  }
+
+//---------------------------------------------------------
+private:
+  static int m_ilevel;
+  int m_num_space;
+};
+
+int Indenter::m_ilevel = 0;
+
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Circle(" << m_x << ',' << m_y << ','
+       << m_radius << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Triangle(" << m_x << ',' << m_y << ','
+       << m_len << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Rectangle(" << m_x << ',' << m_y << ','
+       << m_w << ',' << m_h << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    for (auto &s : m_shape)
+      std::visit([&](auto&& t) { t.draw(os); }, s);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto begin() const { return m_shape.begin(); }
+  auto cbegin() const { return m_shape.cbegin(); }
+
+  auto end() { return m_shape.end(); }
+  auto end() const { return m_shape.end(); }
+  auto cend() const { return m_shape.cend(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    const char *p = "";
+    const char *postfix = ",\n";
+
+    m_os << "\"drawing\": [\n";
+    for (auto &s : d)
+    {
+      m_os << p;
+      std::visit(*this, s);
+      p = postfix;
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+//=========================================================
+class ToYAML {
+public:
+
+  ToYAML(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    Indenter ind;
+
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "circle:\n"
+         << ind << "- x: " << x << '\n'
+         << ind << "- y: " << y << '\n'
+         << ind << "- radius: " << radius << '\n';
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    Indenter ind;
+
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "triangle:\n"
+       << ind << "- x: " << x << '\n'
+       << ind << "- y: " << y << '\n'
+       << ind << "- len: " << len << '\n';
+
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    Indenter ind;
+
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "rectangle: \n"
+         << ind << "- x: " << x << '\n'
+         << ind << "- y: " << y << '\n'
+         << ind << "- w: " << w << '\n'
+         << ind << "- h: " << h << '\n';
+
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    Indenter ind;
+
+    m_os << "drawing:\n";
+    for (auto &s : d)
+    {
+      m_os << ind << "- ";
+      std::visit(*this, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+//=========================================================
+// Sinks receive a drawing as a stream of events. They reuse the leaf
+// overloads of ToJSON/ToYAML and reproduce the punctuation of their
+// operator()(Drawing &), keeping one entry per open drawing.
+class JSONSink {
+public:
+
+  JSONSink(std::ostream &os) : m_os(os), m_json(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T>
+  void leaf(T &s)
+  {
+    next();
+    m_json(s);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void open()
+  {
+    next();
+    m_os << "\"drawing\": [\n";
+    m_first.push_back(true);
+  }
+
+  void close()
+  {
+    m_os << "]\n";
+    m_first.pop_back();
+  }
+
+  std::size_t depth() const { return m_first.size(); }
+
+//---------------------------------------------------------
+private:
+  void next()
+  {
+    if (m_first.empty())
+      return;
+
+    if (!m_first.back())
+      m_os << ",\n";
+    m_first.back() = false;
+  }
+
+  std::ostream &m_os;
+  ToJSON m_json;
+  std::vector<bool> m_first;
+};
+
+
+//=========================================================
+class YAMLSink {
+public:
+
+  YAMLSink(std::ostream &os) : m_os(os), m_yaml(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T>
+  void leaf(T &s)
+  {
+    m_os << m_ind.back() << "- ";
+    m_yaml(s);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void open()
+  {
+    if (!m_ind.empty())
+      m_os << m_ind.back() << "- ";
+
+    m_ind.emplace_back();
+    m_os << "drawing:\n";
+  }
+
+  void close() { m_ind.pop_back(); }
+
+  std::size_t depth() const { return m_ind.size(); }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+  ToYAML m_yaml;
+  std::deque<Indenter> m_ind;   // Indenter is not movable
+};
+
+
+//=========================================================
+// Mirrors Drawing::add, but each shape is handed to the sink as soon as it
+// is added and then forgotten. add<Drawing>() returns a nested builder
+// that closes the sub-drawing when it goes out of scope, so a sub-drawing
+// must be finished before more shapes are added to its parent.
+template<typename Sink>
+class Builder {
+public:
+
+  Builder(Sink &sink) : m_sink(sink)
+  {
+    m_sink.open();
+    m_depth = m_sink.depth();
+  }
+
+  ~Builder() { m_sink.close(); }
+
+  Builder(const Builder &) = delete;
+  Builder &operator=(const Builder &) = delete;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto add(A&&... a)
+  {
+    assert(m_sink.depth() == m_depth);
+
+    if constexpr (std::is_same_v<T, Drawing>)
+      return Builder(m_sink);
+    else
+    {
+      T s(std::forward<A>(a)...);
+      m_sink.leaf(s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  Sink &m_sink;
+  std::size_t m_depth;
+};
+
+
+//=========================================================
+// Discards its output, counting the bytes.
+class NullBuf : public std::streambuf {
+public:
+
+  std::size_t size() const { return m_size; }
+
+//---------------------------------------------------------
+protected:
+  int_type overflow(int_type c) override { ++m_size; return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override
+  {
+    m_size += n;
+    return n;
+  }
+
+private:
+  std::size_t m_size = 0;
+};
+
+
+//=========================================================
+// The drawing from shape6.cc, built either as a Drawing or as a stream.
+template<typename D>
+void example(D &d)
+{
+  d.template add<Circle>(100, 100, 50);
+  d.template add<Triangle>(100, 200, 40);
+
+  {
+    auto &&d1 = d.template add<Drawing>();
+    d1.template add<Rectangle>(50, 50, 25, 50);
+    d1.template add<Rectangle>(75, 75, 25, 50);
+
+    {
+      auto &&d2 = d1.template add<Drawing>();
+      d2.template add<Rectangle>(50, 150, 25, 60);
+      d2.template add<Rectangle>(75, 175, 25, 60);
+    }
+  }
+
+  d.template add<Circle>(10, 10, 5);
+}
+
+
+//=========================================================
+int main()
+{
+  // Build, then serialize.
+  Drawing d;
+  example(d);
+
+  std::ostringstream json_tree, yaml_tree;
+  ToJSON json(json_tree);
+  json(d);
+
+  ToYAML yaml(yaml_tree);
+  yaml(d);
+
+  // Stream straight into the serializer.
+  std::ostringstream json_stream, yaml_stream;
+  {
+    JSONSink sink(json_stream);
+    Builder b(sink);
+    example(b);
+  }
+  {
+    YAMLSink sink(yaml_stream);
+    Builder b(sink);
+    example(b);
+  }
+
+  std::cout << json_stream.str() << yaml_stream.str()
+            << "JSON identical: " << std::boolalpha
+            << (json_tree.str() == json_stream.str()) << '\n'
+            << "YAML identical: " << (yaml_tree.str() == yaml_stream.str())
+            << "\n\n";
+
+
+  // A document much larger than the shapes we keep in memory.
+  NullBuf buf;
+  std::ostream null(&buf);
+  const int n = 10'000'000;
+
+  auto t0 = std::chrono::steady_clock::now();
+  {
+    JSONSink sink(null);
+    Builder root(sink);
+    for (int i = 0; i < n; i += 1000)
+    {
+      auto sub = root.add<Drawing>();
+      for (int j = i; j < i + 1000; ++j)
+        sub.add<Rectangle>(j % 4000, j / 4000, 25, 50);
+    }
+  }
+  std::chrono::duration<double> s = std::chrono::steady_clock::now() - t0;
+
+  std::cout << "streamed " << n << " shapes, " << buf.size() << " bytes of JSON in "
+            << s.count() << " s\n";
+
+  return 0;
+}
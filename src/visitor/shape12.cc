@@ -0,0 +1,465 @@
+/*
+clang++ -std=c++20 -O2 -pthread shape12.cc \
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <system_error>
+#include <stdexcept>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Circle(" << m_x << ',' << m_y << ','
+       << m_radius << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Triangle(" << m_x << ',' << m_y << ','
+       << m_len << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Rectangle(" << m_x << ',' << m_y << ','
+       << m_w << ',' << m_h << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    for (auto &s : m_shape)
+      std::visit([&](auto&& t) { t.draw(os); }, s);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto begin() const { return m_shape.begin(); }
+  auto cbegin() const { return m_shape.cbegin(); }
+
+  auto end() { return m_shape.end(); }
+  auto end() const { return m_shape.end(); }
+  auto cend() const { return m_shape.cend(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    const char *p = "";
+    const char *postfix = ",\n";
+
+    m_os << "\"drawing\": [\n";
+    for (auto &s : d)
+    {
+      m_os << p;
+      std::visit(*this, s);
+      p = postfix;
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+//=========================================================
+// A streambuf that hands each filled buffer to a writer thread and carries
+// on filling the next one. At most 'count' buffers of 'size' bytes exist,
+// so the serializer only waits when the disk falls that far behind.
+//
+// A failed write makes the stream bad at the next buffer or flush. close()
+// throws std::system_error with the first error. Without at least one
+// buffer of at least one byte there is nowhere to write to, and the
+// constructor throws std::invalid_argument before it opens the file.
+class AsyncFileBuf : public std::streambuf {
+public:
+
+  enum class Sync { none, on_close, every_buffer };
+
+  AsyncFileBuf(const char *path, Sync sync = Sync::on_close,
+    std::size_t size = 1 << 20, int count = 2)
+    : m_fd(open(path, size, count)), m_sync(sync), m_size(size)
+  {
+    if (m_fd < 0)
+      throw std::system_error(errno, std::generic_category(), path);
+
+    for (int i = 0; i < count; ++i)
+    {
+      m_buffer.push_back(std::make_unique<char[]>(size));
+      m_free.push_back(m_buffer.back().get());
+    }
+
+    next();
+    m_writer = std::thread([this] { run(); });
+  }
+
+  // The destructor closes the file too, but can only drop an error.
+  ~AsyncFileBuf()
+  {
+    try { close(); } catch (const std::system_error &) {}
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Writes what is left and closes the file.
+  void close()
+  {
+    if (m_fd < 0)
+      return;
+
+    sync();
+    {
+      std::lock_guard lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    m_writer.join();
+
+    if (m_sync == Sync::on_close && ::fsync(m_fd) != 0 && !m_error)
+      m_error = errno;
+    if (::close(m_fd) != 0 && !m_error)
+      m_error = errno;
+    m_fd = -1;
+
+    if (m_error)
+      throw std::system_error(m_error, std::generic_category(), "AsyncFileBuf");
+  }
+
+//---------------------------------------------------------
+protected:
+  int_type overflow(int_type c) override
+  {
+    submit();
+    if (failed())
+      return traits_type::eof();
+    if (c != traits_type::eof())
+    {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Waits until everything written so far has reached the file.
+  int sync() override
+  {
+    submit();
+
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_full.empty() && !m_busy; });
+    return m_error ? -1 : 0;
+  }
+
+//---------------------------------------------------------
+private:
+  static int open(const char *path, std::size_t size, int count)
+  {
+    if (size == 0 || count < 1)
+      throw std::invalid_argument("AsyncFileBuf: needs at least one buffer of at least one byte");
+    return ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Queues the current buffer and switches to a free one.
+  void submit()
+  {
+    if (pptr() == pbase())
+      return;
+
+    {
+      std::lock_guard lock(m_mutex);
+      m_full.emplace_back(pbase(), pptr() - pbase());
+    }
+    m_cv.notify_all();
+    next();
+  }
+
+  bool failed()
+  {
+    std::lock_guard lock(m_mutex);
+    return m_error;
+  }
+
+  void next()
+  {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [&] { return !m_free.empty(); });
+
+    char *p = m_free.back();
+    m_free.pop_back();
+    setp(p, p + m_size);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void run()
+  {
+    std::unique_lock lock(m_mutex);
+    for (;;)
+    {
+      m_cv.wait(lock, [&] { return !m_full.empty() || m_stop; });
+      if (m_full.empty())
+        return;
+
+      auto [p, n] = m_full.front();
+      m_full.pop_front();
+      m_busy = true;
+      lock.unlock();
+
+      int error = write(p, n);
+      if (!error && m_sync == Sync::every_buffer && ::fsync(m_fd) != 0)
+        error = errno;
+
+      lock.lock();
+      if (!m_error)
+        m_error = error;
+      m_busy = false;
+      m_free.push_back(p);
+      m_cv.notify_all();
+    }
+  }
+
+  // Returns 0 or the errno of the failed write.
+  int write(const char *p, std::size_t n)
+  {
+    while (n > 0)
+    {
+      auto r = ::write(m_fd, p, n);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r < 0)
+        return errno;
+      p += r;
+      n -= r;
+    }
+    return 0;
+  }
+
+  int m_fd;
+  Sync m_sync;
+  std::size_t m_size;
+
+  std::vector<std::unique_ptr<char[]>> m_buffer;
+  std::vector<char*> m_free;
+  std::deque<std::pair<char*, std::size_t>> m_full;
+  bool m_busy = false;
+  int m_error = 0;
+  bool m_stop = false;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::thread m_writer;
+};
+
+
+//=========================================================
+// Discards its output.
+class NullBuf : public std::streambuf {
+protected:
+  int_type overflow(int_type c) override { return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename F>
+double seconds(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main(int argc, char *argv[])
+{
+  const char *path = argc > 1 ? argv[1] : "shape12.json";
+
+  Drawing d;
+  d.add<Circle>(100, 100, 50);
+
+  auto &triangle = d.add<Triangle>(100, 200, 40);
+
+  auto &d1 = d.add<Drawing>();
+  d1.add<Rectangle>(50, 50, 25, 50);
+  d1.add<Rectangle>(75, 75, 25, 50);
+
+  auto &d2 = d1.add<Drawing>();
+  d2.add<Rectangle>(50, 150, 25, 60);
+  d2.add<Rectangle>(75, 175, 25, 60);
+
+  for (int i = 0; i < 2'000'000; ++i)
+    d2.add<Circle>(i % 4000, i / 4000, 10);
+
+  // CPU only.
+  NullBuf null;
+  std::ostream null_os(&null);
+  auto cpu = seconds([&] { ToJSON json(null_os); json(d); });
+
+  // Serialize and write in turn.
+  auto blocking = seconds([&] {
+    std::ofstream os(path);
+    ToJSON json(os);
+    json(d);
+    os.flush();
+    int fd = ::open(path, O_WRONLY);
+    if (fd >= 0)
+    {
+      ::fsync(fd);
+      ::close(fd);
+    }
+  });
+
+  // Serialize while the previous buffer is written.
+  double async;
+  try
+  {
+    async = seconds([&] {
+      AsyncFileBuf buf(path, AsyncFileBuf::Sync::on_close);
+      std::ostream os(&buf);
+      ToJSON json(os);
+      json(d);
+      buf.close();
+    });
+  }
+  catch (const std::system_error &e)
+  {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  std::cout << "toJSON to " << path << '\n'
+            << "  serialize only: " << cpu << " s\n"
+            << "  ofstream:       " << blocking << " s\n"
+            << "  AsyncFileBuf:   " << async << " s\n";
+
+  return 0;
+}
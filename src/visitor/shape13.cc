@@ -0,0 +1,597 @@
+/*
+clang++ -std=c++20 -O2 shape13.cc \
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <random>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+
+
+//=========================================================
+class Indenter {
+public:
+
+  Indenter(int num_space = 2) : m_num_space(num_space)
+  {
+    m_ilevel += m_num_space;
+  }
+
+  ~Indenter()
+  {
+    m_ilevel -= m_num_space;
+    if (m_ilevel < 0)
+      m_ilevel = 0;
+  }
+
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  friend std::ostream& operator<<(std::ostream &os, const Indenter &ind)
+  {
+    for (int i = 0; i < ind.m_ilevel; ++i)
+      os << ' ';
+    return os;
+  }
+
+//---------------------------------------------------------
+private:
+  static int m_ilevel;
+  int m_num_space;
+};
+
+int Indenter::m_ilevel = 0;
+
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Circle(" << m_x << ',' << m_y << ','
+       << m_radius << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Triangle(" << m_x << ',' << m_y << ','
+       << m_len << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    os << "Rectangle(" << m_x << ',' << m_y << ','
+       << m_w << ',' << m_h << ')' << std::endl;
+  }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void draw(std::ostream &os)
+  {
+    for (auto &s : m_shape)
+      std::visit([&](auto&& t) { t.draw(os); }, s);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto begin() const { return m_shape.begin(); }
+  auto cbegin() const { return m_shape.cbegin(); }
+
+  auto end() { return m_shape.end(); }
+  auto end() const { return m_shape.end(); }
+  auto cend() const { return m_shape.cend(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    const char *p = "";
+    const char *postfix = ",\n";
+
+    m_os << "\"drawing\": [\n";
+    for (auto &s : d)
+    {
+      m_os << p;
+      std::visit(*this, s);
+      p = postfix;
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+//=========================================================
+class ToYAML {
+public:
+
+  ToYAML(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    Indenter ind;
+
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "circle:\n"
+         << ind << "- x: " << x << '\n'
+         << ind << "- y: " << y << '\n'
+         << ind << "- radius: " << radius << '\n';
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    Indenter ind;
+
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "triangle:\n"
+       << ind << "- x: " << x << '\n'
+       << ind << "- y: " << y << '\n'
+       << ind << "- len: " << len << '\n';
+
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    Indenter ind;
+
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "rectangle: \n"
+         << ind << "- x: " << x << '\n'
+         << ind << "- y: " << y << '\n'
+         << ind << "- w: " << w << '\n'
+         << ind << "- h: " << h << '\n';
+
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    Indenter ind;
+
+    m_os << "drawing:\n";
+    for (auto &s : d)
+    {
+      m_os << ind << "- ";
+      std::visit(*this, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+//=========================================================
+// The wire format: one tag byte per record followed by the fields as
+// zig-zag varints. Each field is sent as the difference from the same
+// field of the previous shape of that type. A drawing is a 'drawing' tag,
+// its shapes and an 'end' tag.
+enum Tag : std::uint8_t { circle, triangle, rectangle, drawing, end };
+
+//=========================================================
+class ToWire {
+public:
+
+  ToWire(std::string &out) : m_out(out) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto [x, y] = s.getPosition();
+    m_out.push_back(circle);
+    delta(m_circle, {x, y, s.getSize()});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    m_out.push_back(triangle);
+    delta(m_triangle, {x, y, s.getSize()});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+    m_out.push_back(rectangle);
+    delta(m_rectangle, {x, y, w, h});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    m_out.push_back(drawing);
+    for (auto &s : d)
+      std::visit(*this, s);
+    m_out.push_back(end);
+  }
+
+//---------------------------------------------------------
+private:
+  template<std::size_t N>
+  void delta(std::array<int, N> &prev, const std::array<int, N> &cur)
+  {
+    for (std::size_t i = 0; i < N; ++i)
+      varint(zigzag(std::int64_t(cur[i]) - prev[i]));
+    prev = cur;
+  }
+
+  static std::uint64_t zigzag(std::int64_t v)
+  {
+    return (std::uint64_t(v) << 1) ^ std::uint64_t(v >> 63);
+  }
+
+  void varint(std::uint64_t v)
+  {
+    char buf[10];
+    int n = 0;
+    while (v >= 0x80)
+    {
+      buf[n++] = char(v | 0x80);
+      v >>= 7;
+    }
+    buf[n++] = char(v);
+    m_out.append(buf, n);
+  }
+
+  std::string &m_out;
+  std::array<int, 3> m_circle{}, m_triangle{};
+  std::array<int, 4> m_rectangle{};
+};
+
+
+//=========================================================
+// Rebuilds a Drawing from the output of ToWire. The input comes from
+// another service, so anything ToWire would not have written throws a
+// std::runtime_error: truncated input, an unknown tag, a varint longer
+// than 10 bytes or bytes after the drawing. Drawings nested deeper than
+// 'max_depth' are rejected too, so the recursion cannot run out of stack.
+class FromWire {
+public:
+
+  FromWire(std::string_view in, int max_depth = 256)
+    : m_p(reinterpret_cast<const std::uint8_t*>(in.data())), m_end(m_p + in.size()),
+      m_max_depth(max_depth) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    if (byte() != drawing)
+      fail("does not start with a drawing");
+    read(d, 0);
+    if (m_p != m_end)
+      fail("bytes after the drawing");
+  }
+
+//---------------------------------------------------------
+private:
+  [[noreturn]] static void fail(const char *what)
+  {
+    throw std::runtime_error(std::string("FromWire: ") + what);
+  }
+
+  std::uint8_t byte()
+  {
+    if (m_p == m_end)
+      fail("truncated");
+    return *m_p++;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void read(Drawing &d, int depth)
+  {
+    if (depth > m_max_depth)
+      fail("drawings nested too deep");
+
+    for (;;)
+    {
+      switch (byte())
+      {
+        case circle:
+          delta(m_circle);
+          d.add<Circle>(m_circle[0], m_circle[1], m_circle[2]);
+          break;
+
+        case triangle:
+          delta(m_triangle);
+          d.add<Triangle>(m_triangle[0], m_triangle[1], m_triangle[2]);
+          break;
+
+        case rectangle:
+          delta(m_rectangle);
+          d.add<Rectangle>(m_rectangle[0], m_rectangle[1],
+            m_rectangle[2], m_rectangle[3]);
+          break;
+
+        case drawing: read(d.add<Drawing>(), depth + 1); break;
+        case end: return;
+        default: fail("unknown tag");
+      }
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<std::size_t N>
+  void delta(std::array<int, N> &prev)
+  {
+    for (auto &v : prev)
+    {
+      auto z = varint();
+      auto diff = std::int64_t(z >> 1) ^ -std::int64_t(z & 1);
+      v = int(std::uint32_t(v) + std::uint32_t(diff));
+    }
+  }
+
+  // At most 10 bytes, and the 10th may only hold the top bit of 64.
+  std::uint64_t varint()
+  {
+    std::uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+      auto b = byte();
+      if (shift == 63 && b > 1)
+        fail("varint overflows 64 bits");
+      v |= std::uint64_t(b & 0x7f) << shift;
+      if (b < 0x80)
+        return v;
+    }
+    fail("varint overflows 64 bits");
+  }
+
+  const std::uint8_t *m_p, *m_end;
+  int m_max_depth;
+  std::array<int, 3> m_circle{}, m_triangle{};
+  std::array<int, 4> m_rectangle{};
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename F>
+double seconds(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+std::string json_of(Drawing &d)
+{
+  std::ostringstream os;
+  ToJSON json(os);
+  json(d);
+  return os.str();
+}
+
+
+//=========================================================
+int main()
+{
+  Drawing d;
+  d.add<Circle>(100, 100, 50);
+
+  auto &triangle = d.add<Triangle>(100, 200, 40);
+
+  auto &d1 = d.add<Drawing>();
+  d1.add<Rectangle>(50, 50, 25, 50);
+  d1.add<Rectangle>(75, 75, 25, 50);
+
+  auto &d2 = d1.add<Drawing>();
+  d2.add<Rectangle>(50, 150, 25, 60);
+  d2.add<Rectangle>(75, 175, 25, 60);
+
+  d.add<Drawing>();
+  d.add<Circle>(-2147483647 - 1, 2147483647, 0);
+
+  // Round trip
+  std::string wire;
+  ToWire to(wire);
+  to(d);
+
+  Drawing back;
+  FromWire from(wire);
+  from(back);
+
+  std::cout << "round trip: " << wire.size() << " bytes, identical: "
+            << std::boolalpha << (json_of(d) == json_of(back)) << "\n\n";
+
+  // Input that ToWire would not have written.
+  std::string deep(1000, char(drawing));
+  deep.append(1000, char(end));
+
+  for (auto bad : {wire.substr(0, wire.size() - 3), wire + char(end),
+    std::string("\3\7\4"), std::string("\3\0\xff\xff\xff\xff\xff\xff\xff\xff\xff\x7f", 12), deep})
+  {
+    try
+    {
+      Drawing d;
+      FromWire from(bad);
+      from(d);
+    }
+    catch (const std::runtime_error &e)
+    {
+      std::cout << e.what() << '\n';
+    }
+  }
+  std::cout << '\n';
+
+
+  // Size and speed. Shapes are laid out roughly in order, as generated
+  // drawings usually are.
+  const int n = 1'000'000;
+  Drawing big;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> step(-20, 20), kind(0, 2);
+  int x = 0, y = 0;
+  for (int i = 0; i < n; i += 1000)
+  {
+    auto &sub = big.add<Drawing>();
+    for (int j = 0; j < 1000; ++j)
+    {
+      x += step(rng) + 10;
+      y += step(rng);
+      switch (kind(rng))
+      {
+        case 0: sub.add<Circle>(x, y, 10); break;
+        case 1: sub.add<Triangle>(x, y, 20); break;
+        case 2: sub.add<Rectangle>(x, y, 25, 50); break;
+      }
+    }
+  }
+
+  std::ostringstream json_os, yaml_os;
+  std::string bytes, copy;
+  Drawing decoded;
+
+  auto json_s = seconds([&] { ToJSON json(json_os); json(big); });
+  auto yaml_s = seconds([&] { ToYAML yaml(yaml_os); yaml(big); });
+  auto encode_s = seconds([&] { ToWire w(bytes); w(big); });
+  auto decode_s = seconds([&] { FromWire r(bytes); r(decoded); });
+  auto copy_s = seconds([&] { copy = json_os.str(); });
+
+  auto row = [&](const char *name, std::size_t size, double s) {
+    std::cout << std::setw(14) << std::left << name << std::setw(10) << std::right
+              << size << " bytes " << std::setw(9) << s * 1000 << " ms\n";
+  };
+
+  std::cout << n << " shapes\n";
+  row("toJSON", json_os.str().size(), json_s);
+  row("toYAML", yaml_os.str().size(), yaml_s);
+  row("ToWire", bytes.size(), encode_s);
+  row("FromWire", bytes.size(), decode_s);
+  row("memcpy JSON", copy.size(), copy_s);
+  std::cout << "identical: " << (json_of(big) == json_of(decoded)) << '\n';
+
+  return 0;
+}
@@ -0,0 +1,360 @@
+/*
+clang++ -std=c++20 shape15.cc \
+  -I ~/opt/include \
+  -L ~/opt/lib -lsfml-graphics -lsfml-window -lsfml-system
+
+  Press <Esc> to close the graphic window.
+  The trace is written to shape15.trace.json; open it in chrome://tracing
+  or https://ui.perfetto.dev
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+
+#include <SFML/Graphics.hpp>
+
+
+//=========================================================
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &emplace_back(A&&... a)
+  {
+    auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
+      std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : m_composite)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<value_type> m_composite;
+};
+
+
+
+//=========================================================
+// A fixed-size ring of completed spans. Writers claim a slot with a single
+// fetch_add and never block; when the ring is full the oldest spans are
+// overwritten. Each slot carries a sequence number so that a reader on
+// another thread can skip slots that are being written.
+class TraceRing {
+public:
+
+  struct Event {
+    const char *name;
+    std::int64_t begin;   // microseconds since the ring was created
+    std::int64_t duration;
+    std::int64_t arg;
+  };
+
+  TraceRing(std::size_t capacity = 1 << 16)
+    : m_slot(capacity), m_t0(std::chrono::steady_clock::now()) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::int64_t now() const
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - m_t0).count();
+  }
+
+  void push(const Event &e)
+  {
+    auto i = m_next.fetch_add(1, std::memory_order_relaxed);
+    auto &slot = m_slot[i % m_slot.size()];
+
+    slot.seq.store(2 * i + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = e;
+    slot.seq.store(2 * i + 2, std::memory_order_release);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The spans currently held, oldest first.
+  std::vector<Event> events() const
+  {
+    std::vector<Event> v;
+    auto next = m_next.load(std::memory_order_acquire);
+    auto first = next > m_slot.size() ? next - m_slot.size() : 0;
+
+    for (auto i = first; i < next; ++i)
+    {
+      auto &slot = m_slot[i % m_slot.size()];
+      auto seq = slot.seq.load(std::memory_order_acquire);
+      Event e = slot.event;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq == 2 * i + 2 && slot.seq.load(std::memory_order_relaxed) == seq)
+        v.push_back(e);
+    }
+    return v;
+  }
+
+//---------------------------------------------------------
+private:
+  struct Slot {
+    std::atomic<std::uint64_t> seq{0};
+    Event event{};
+  };
+
+  std::vector<Slot> m_slot;
+  std::atomic<std::uint64_t> m_next{0};
+  std::chrono::steady_clock::time_point m_t0;
+};
+
+
+//=========================================================
+// Records the time between its construction and destruction.
+class Span {
+public:
+
+  Span(TraceRing &ring, const char *name)
+    : m_ring(ring), m_name(name), m_begin(ring.now()) {}
+
+  ~Span() { m_ring.push({m_name, m_begin, m_ring.now() - m_begin, m_arg}); }
+
+  void arg(std::int64_t a) { m_arg = a; }
+
+//---------------------------------------------------------
+private:
+  TraceRing &m_ring;
+  const char *m_name;
+  std::int64_t m_begin;
+  std::int64_t m_arg = 0;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Writes the spans in the Chrome trace-event format.
+void write_trace(const TraceRing &ring, std::ostream &os)
+{
+  const char *p = "";
+
+  os << "{\"traceEvents\": [\n";
+  for (auto &e : ring.events())
+  {
+    os << p << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, "
+       << "\"tid\": 1, \"ts\": " << e.begin << ", \"dur\": " << e.duration
+       << ", \"args\": {\"n\": " << e.arg << "}}";
+    p = ",\n";
+  }
+  os << "\n]}\n";
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void frame_times(const TraceRing &ring, std::ostream &os)
+{
+  std::vector<std::int64_t> t;
+  for (auto &e : ring.events())
+    if (std::strcmp(e.name, "frame") == 0)
+      t.push_back(e.duration);
+
+  if (t.empty())
+    return;
+
+  std::sort(t.begin(), t.end());
+  auto at = [&](double p) { return t[std::size_t(p * (t.size() - 1))] / 1000.0; };
+
+  os << t.size() << " frames (ms): p50 " << at(0.5) << ", p99 " << at(0.99)
+     << ", max " << at(1.0) << '\n';
+}
+
+
+
+//===================================================================
+using Color = sf::Color;
+using Pos = sf::Vector2f;
+using V2f = sf::Vector2f;
+
+using Circle = sf::CircleShape;
+using Rectangle = sf::RectangleShape;
+
+//---------------------------------------------------------
+class Triangle : public Circle {
+public:
+  Triangle(float radius) : Circle (radius, 3) {}
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+//---------------------------------------------------------
+class Window : public sf::RenderWindow {
+public:
+  Window(const int width, const int height, const std::string &title)
+    : sf::RenderWindow(sf::VideoMode(width, height), title.c_str())
+  {
+    setVerticalSyncEnabled(true);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { draw(s); ++m_draws; }
+  void operator()(Triangle &s) { draw(s); ++m_draws; }
+  void operator()(Rectangle &s) { draw(s); ++m_draws; }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Each frame is recorded as a 'frame' span holding 'poll', 'traverse'
+  // (with the number of draw calls) and 'display', which includes the
+  // wait for vsync.
+  void show(Drawing &d)
+  {
+    while(isOpen())
+    {
+      Span frame(m_trace, "frame");
+
+      {
+        Span poll(m_trace, "poll");
+        sf::Event event;
+        while (pollEvent(event))
+        {
+          switch(event.type)
+          {
+            case sf::Event::Closed: close(); break;
+            case sf::Event::KeyPressed:
+              switch (event.key.code)
+              {
+                case sf::Keyboard::Escape: close(); break;
+                default: break;
+              }
+            break;
+
+            default: break;
+          }
+        }
+      }
+
+      {
+        Span traverse(m_trace, "traverse");
+        m_draws = 0;
+        clear();
+        (*this)(d);
+        traverse.arg(m_draws);
+      }
+
+      {
+        Span wait(m_trace, "display");
+        display();
+      }
+    }
+  }
+
+  const TraceRing &trace() const { return m_trace; }
+
+//---------------------------------------------------------
+private:
+  TraceRing m_trace;
+  std::int64_t m_draws = 0;
+};
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setRadius(s.getRadius() * m_ratio); }
+  void operator()(Triangle &s) { s.setRadius(s.getRadius() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto sz = s.getSize();
+    s.setSize(V2f{sz.x * m_ratio, sz.y * m_ratio});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+class FillColor {
+public:
+
+  FillColor(Color c) : m_color(c) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setFillColor(m_color); }
+  void operator()(Triangle &s) { s.setFillColor(m_color); }
+  void operator()(Rectangle &s) { s.setFillColor(m_color); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  Color m_color;
+};
+
+
+//=========================================================
+int main()
+{
+  Window window(300, 400, "visitor");
+
+  Drawing d;
+  auto & circle = d.emplace_back<Circle>(50.f);
+  circle.setFillColor(Color::Red);
+  circle.setPosition(Pos(100,100));
+
+  auto &triangle = d.emplace_back<Triangle>(50.f);
+  triangle.setPosition(Pos(100,200));
+  triangle.setFillColor(Color::Green);
+
+  auto &d1 = d.emplace_back<Drawing>();
+  auto &r1 = d1.emplace_back<Rectangle>(V2f{25, 50});
+  r1.setPosition(Pos(50,50));
+
+  auto &r2 = d1.emplace_back<Rectangle>(V2f{25, 50});
+  r2.setPosition(Pos(75, 75));
+  r2.setFillColor(Color::Blue);
+
+  // Before the next emplace_back(), which may move d1.
+  FillColor yellow(Color::Yellow);
+  yellow(d1);
+
+  // Enough shapes to make a frame take a while.
+  auto &d2 = d.emplace_back<Drawing>();
+  for (int i = 0; i < 20000; ++i)
+  {
+    auto &c = d2.emplace_back<Circle>(2.f);
+    c.setPosition(Pos(i % 300, (i / 300) * 6 % 400));
+  }
+
+  Scale bigger(2.0);
+  bigger(d);
+  window.show(d);
+
+  std::ofstream trace("shape15.trace.json");
+  write_trace(window.trace(), trace);
+  frame_times(window.trace(), std::cout);
+
+  return 0;
+}
@@ -0,0 +1,311 @@
+/*
+clang++ -std=c++20 shape16.cc \
+  -I ~/opt/include \
+  -L ~/opt/lib -lsfml-graphics -lsfml-window -lsfml-system
+
+  Press <+>/<-> to scale the drawing and <Esc> to close the graphic window.
+  Run with --headless to only run the check against a fake target.
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <vector>
+#include <deque>
+
+#include <SFML/Graphics.hpp>
+
+
+//=========================================================
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &emplace_back(A&&... a)
+  {
+    auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
+      std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : m_composite)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<value_type> m_composite;
+};
+
+
+
+//===================================================================
+using Color = sf::Color;
+using Pos = sf::Vector2f;
+using V2f = sf::Vector2f;
+
+using Circle = sf::CircleShape;
+using Rectangle = sf::RectangleShape;
+
+//---------------------------------------------------------
+class Triangle : public Circle {
+public:
+  Triangle(float radius) : Circle (radius, 3) {}
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setRadius(s.getRadius() * m_ratio); }
+  void operator()(Triangle &s) { s.setRadius(s.getRadius() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto sz = s.getSize();
+    s.setSize(V2f{sz.x * m_ratio, sz.y * m_ratio});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+class FillColor {
+public:
+
+  FillColor(Color c) : m_color(c) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setFillColor(m_color); }
+  void operator()(Triangle &s) { s.setFillColor(m_color); }
+  void operator()(Rectangle &s) { s.setFillColor(m_color); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  Color m_color;
+};
+
+
+
+//---------------------------------------------------------
+class Window : public sf::RenderWindow {
+public:
+  Window(const int width, const int height, const std::string &title)
+    : sf::RenderWindow(sf::VideoMode(width, height), title.c_str())
+  {
+    setVerticalSyncEnabled(true);
+  }
+};
+
+
+//---------------------------------------------------------
+// Stands in for a Window in tests: replays a list of events and counts
+// what would have been drawn. Closes itself when it runs out of events.
+class FakeTarget {
+public:
+
+  FakeTarget(std::deque<sf::Event> events) : m_event(std::move(events)) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool isOpen() const { return m_open; }
+  void close() { m_open = false; }
+
+  // Events are only handed out by waitEvent(), one at a time, as if each
+  // arrived while the loop was blocked.
+  bool pollEvent(sf::Event &) { return false; }
+  bool waitEvent(sf::Event &event)
+  {
+    if (m_event.empty())
+    {
+      close();
+      return false;
+    }
+
+    event = m_event.front();
+    m_event.pop_front();
+    return true;
+  }
+
+  void clear() {}
+  void draw(const sf::Drawable &) { ++m_draws; }
+  void display() { ++m_frames; }
+
+  int frames() const { return m_frames; }
+  int draws() const { return m_draws; }
+
+//---------------------------------------------------------
+private:
+  std::deque<sf::Event> m_event;
+  bool m_open = true;
+  int m_draws = 0, m_frames = 0;
+};
+
+
+//=========================================================
+// Draws a drawing on any Target with the RenderWindow interface, and
+// only when something changed: the loop blocks in waitEvent() until an
+// event arrives, and redraws if the drawing was marked dirty.
+template<typename Target>
+class Viewer {
+public:
+
+  Viewer(Target &target) : m_target(target) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { m_target.draw(s); }
+  void operator()(Triangle &s) { m_target.draw(s); }
+  void operator()(Rectangle &s) { m_target.draw(s); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+  void invalidate() { m_dirty = true; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void show(Drawing &d)
+  {
+    invalidate();
+    while (m_target.isOpen())
+    {
+      sf::Event event;
+      if (!m_dirty && m_target.waitEvent(event))
+        handle(d, event);
+
+      while (m_target.pollEvent(event))
+        handle(d, event);
+
+      if (m_dirty && m_target.isOpen())
+      {
+        m_target.clear();
+        (*this)(d);
+        m_target.display();
+        m_dirty = false;
+      }
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  void handle(Drawing &d, const sf::Event &event)
+  {
+    switch(event.type)
+    {
+      case sf::Event::Closed: m_target.close(); break;
+      case sf::Event::Resized:
+      case sf::Event::GainedFocus: invalidate(); break;
+      case sf::Event::KeyPressed:
+        switch (event.key.code)
+        {
+          case sf::Keyboard::Escape: m_target.close(); break;
+          case sf::Keyboard::Add: scale(d, 1.25f); break;
+          case sf::Keyboard::Subtract: scale(d, 0.8f); break;
+          default: break;
+        }
+      break;
+
+      default: break;
+    }
+  }
+
+  void scale(Drawing &d, float ratio)
+  {
+    Scale s(ratio);
+    s(d);
+    invalidate();
+  }
+
+  Target &m_target;
+  bool m_dirty = true;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+sf::Event key(sf::Keyboard::Key code)
+{
+  sf::Event e;
+  e.type = sf::Event::KeyPressed;
+  e.key = {};
+  e.key.code = code;
+  return e;
+}
+
+sf::Event event(sf::Event::EventType type)
+{
+  sf::Event e;
+  e.type = type;
+  return e;
+}
+
+
+//=========================================================
+int main(int argc, char *argv[])
+{
+  Drawing d;
+  auto & circle = d.emplace_back<Circle>(50.f);
+  circle.setFillColor(Color::Red);
+  circle.setPosition(Pos(100,100));
+
+  auto &triangle = d.emplace_back<Triangle>(50.f);
+  triangle.setPosition(Pos(100,200));
+  triangle.setFillColor(Color::Green);
+
+  auto &d1 = d.emplace_back<Drawing>();
+  auto &r1 = d1.emplace_back<Rectangle>(V2f{25, 50});
+  r1.setPosition(Pos(50,50));
+
+  auto &r2 = d1.emplace_back<Rectangle>(V2f{25, 50});
+  r2.setPosition(Pos(75, 75));
+  r2.setFillColor(Color::Blue);
+
+  FillColor yellow(Color::Yellow);
+  yellow(d1);
+
+  // Headless: the first frame, a resize and a scale need a redraw, the
+  // other events do not.
+  FakeTarget fake({
+    key(sf::Keyboard::Space), event(sf::Event::MouseMoved),
+    event(sf::Event::Resized), event(sf::Event::LostFocus),
+    key(sf::Keyboard::Add), key(sf::Keyboard::A)
+  });
+
+  Viewer<FakeTarget> headless(fake);
+  headless.show(d);
+
+  std::cout << "headless: " << fake.frames() << " frames (expected 3), "
+            << fake.draws() << " draws (expected 12)\n";
+
+  if (argc > 1 && std::string(argv[1]) == "--headless")
+    return fake.frames() == 3 && fake.draws() == 12 ? 0 : 1;
+
+
+  Window window(300, 400, "visitor");
+  Viewer<Window> viewer(window);
+  viewer.show(d);
+
+  return 0;
+}
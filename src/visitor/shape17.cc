@@ -0,0 +1,460 @@
+/*
+clang++ -std=c++20 -O2 -pthread shape17.cc \
+*/
+
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <optional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <initializer_list>
+#include <stdexcept>
+#include <cstdint>
+
+
+//=========================================================
+using Color = std::uint32_t;
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_radius(radius), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+  void setSize(int radius) { m_radius = radius; }
+  Color getFillColor() const { return m_fill; }
+  void setFillColor(Color c) { m_fill = c; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+  Color m_fill;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_len(len), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+  void setSize(int len) { m_len = len; }
+  Color getFillColor() const { return m_fill; }
+  void setFillColor(Color c) { m_fill = c; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+  Color m_fill;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_w(w), m_h(h), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+  void setSize(int w, int h) { m_w = w; m_h = h; }
+  Color getFillColor() const { return m_fill; }
+  void setFillColor(Color c) { m_fill = c; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+  Color m_fill;
+};
+
+
+//=========================================================
+// An immutable, published drawing. Sub-drawings are shared between
+// successive snapshots for as long as they do not change.
+class Snapshot;
+using Frozen = std::variant<Circle, Triangle, Rectangle,
+  std::shared_ptr<const Snapshot>>;
+
+class Snapshot {
+public:
+
+  Snapshot(std::vector<Frozen> shape) : m_shape(std::move(shape)) {}
+
+  auto begin() const { return m_shape.begin(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  const std::vector<Frozen> m_shape;
+};
+
+
+//=========================================================
+// The writer's working copy. Each drawing remembers the snapshot it last
+// published, and whether it has changed since.
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    m_changed = true;
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto end() { return m_shape.end(); }
+
+  Drawing &operator[](std::size_t i) { return std::get<Drawing>(m_shape[i]); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // 'changed' means this drawing's own list must be rebuilt, 'deep' that
+  // everything below it must be rebuilt as well.
+  void touch(bool deep)
+  {
+    m_changed = true;
+    m_deep = m_deep || deep;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Unchanged drawings return their previous snapshot without being
+  // looked at, so the cost is proportional to what changed.
+  std::shared_ptr<const Snapshot> freeze(bool deep, std::size_t &rebuilt)
+  {
+    deep = deep || m_deep;
+    if (m_published && !m_changed && !deep)
+      return m_published;
+
+    std::vector<Frozen> v;
+    v.reserve(m_shape.size());
+    for (auto &s : m_shape)
+    {
+      if (auto d = std::get_if<Drawing>(&s))
+        v.emplace_back(d->freeze(deep, rebuilt));
+      else
+        std::visit([&](auto &leaf) {
+          if constexpr (!std::is_same_v<std::decay_t<decltype(leaf)>, Drawing>)
+            v.emplace_back(leaf);
+        }, s);
+    }
+
+    rebuilt += v.size();
+    m_published = std::make_shared<const Snapshot>(std::move(v));
+    m_changed = m_deep = false;
+    return m_published;
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+  std::shared_ptr<const Snapshot> m_published;
+  bool m_changed = true;
+  bool m_deep = false;
+};
+
+
+//=========================================================
+// One writer edits the working copy and publishes it; any number of
+// readers traverse the current snapshot without taking a lock.
+//
+// std::atomic<std::shared_ptr> would do, but libstdc++ implements it with
+// a lock, so the current snapshot is a plain atomic pointer instead, and
+// replaced snapshots are kept alive with hazard pointers. Each reader
+// thread owns a slot in which it announces the snapshot it is reading.
+// The writer frees a replaced snapshot once no slot holds it, at the next
+// publish.
+class Document {
+public:
+
+  static constexpr std::size_t max_readers = 16;
+
+  Document() { publish(); }
+
+  //=========================================================
+  // One per reader thread.
+  class Reader {
+  public:
+
+    Reader(Document &doc);
+    ~Reader();
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+    // The current snapshot, valid until the next call or until the
+    // Reader goes away. Retries only if a publish happened in between.
+    const Snapshot &snapshot()
+    {
+      auto &hazard = m_doc.m_hazard[m_slot].snapshot;
+      auto p = m_doc.m_current.load(std::memory_order_acquire);
+      for (;;)
+      {
+        hazard.store(p, std::memory_order_seq_cst);
+        auto q = m_doc.m_current.load(std::memory_order_seq_cst);
+        if (q == p)
+          return *p;
+        p = q;
+      }
+    }
+
+  //---------------------------------------------------------
+  private:
+    Document &m_doc;
+    std::size_t m_slot;
+  };
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Writer: the sub-drawing at 'path', with the drawings leading to it
+  // marked as changed.
+  Drawing &edit(std::initializer_list<std::size_t> path, bool deep = false)
+  {
+    Drawing *d = &m_root;
+    d->touch(false);
+    for (auto i : path)
+    {
+      d = &(*d)[i];
+      d->touch(false);
+    }
+    d->touch(deep);
+    return *d;
+  }
+
+  // Writer: applies a mutating visitor to the sub-drawing at 'path'.
+  template<typename V>
+  void apply(std::initializer_list<std::size_t> path, V visitor)
+  {
+    visitor(edit(path, true));
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Writer: returns the number of shapes copied.
+  std::size_t publish()
+  {
+    std::size_t rebuilt = 0;
+    auto next = m_root.freeze(false, rebuilt);
+    if (next == m_published)
+      return rebuilt;
+
+    if (m_published)
+      m_retired.push_back(std::move(m_published));
+    m_published = std::move(next);
+    m_current.store(m_published.get(), std::memory_order_seq_cst);
+
+    std::erase_if(m_retired, [&](auto &r) {
+      for (auto &h : m_hazard)
+        if (h.snapshot.load(std::memory_order_seq_cst) == r.get())
+          return false;
+      return true;
+    });
+    return rebuilt;
+  }
+
+  std::size_t retired() const { return m_retired.size(); }
+
+//---------------------------------------------------------
+private:
+  struct alignas(64) Hazard {
+    std::atomic<const Snapshot*> snapshot = nullptr;
+    std::atomic<bool> used = false;
+  };
+
+  static_assert(std::atomic<const Snapshot*>::is_always_lock_free);
+
+  Drawing m_root;
+  std::shared_ptr<const Snapshot> m_published;
+  std::vector<std::shared_ptr<const Snapshot>> m_retired;
+
+  std::atomic<const Snapshot*> m_current = nullptr;
+  Hazard m_hazard[max_readers];
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+inline Document::Reader::Reader(Document &doc) : m_doc(doc), m_slot(0)
+{
+  while (m_doc.m_hazard[m_slot].used.exchange(true))
+    if (++m_slot == max_readers)
+      throw std::runtime_error("Document: too many readers");
+}
+
+inline Document::Reader::~Reader()
+{
+  m_doc.m_hazard[m_slot].snapshot.store(nullptr);
+  m_doc.m_hazard[m_slot].used.store(false);
+}
+
+
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setSize(s.getSize() * m_ratio); }
+  void operator()(Triangle &s) { s.setSize(s.getSize() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    s.setSize(w * m_ratio, h * m_ratio);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+class FillColor {
+public:
+
+  FillColor(Color c) : m_color(c) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setFillColor(m_color); }
+  void operator()(Triangle &s) { s.setFillColor(m_color); }
+  void operator()(Rectangle &s) { s.setFillColor(m_color); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+//---------------------------------------------------------
+private:
+  Color m_color;
+};
+
+
+//=========================================================
+// A read-only visitor: checks that every shape in each sub-drawing has the
+// same fill, which the writer below always maintains.
+class Consistent {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T>
+  void operator()(const T &s)
+  {
+    if (m_fill && *m_fill != s.getFillColor())
+      m_ok = false;
+    m_fill = s.getFillColor();
+    ++m_shapes;
+  }
+
+  void operator()(const std::shared_ptr<const Snapshot> &d)
+  {
+    auto fill = m_fill;
+    m_fill = {};
+    (*this)(*d);
+    m_fill = fill;
+  }
+
+  void operator()(const Snapshot &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+  bool ok() const { return m_ok; }
+  std::size_t shapes() const { return m_shapes; }
+
+//---------------------------------------------------------
+private:
+  std::optional<Color> m_fill;
+  bool m_ok = true;
+  std::size_t m_shapes = 0;
+};
+
+
+//=========================================================
+int main()
+{
+  Document doc;
+
+  // 1000 sub-drawings of 1000 shapes each.
+  auto &root = doc.edit({});
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto &sub = root.add<Drawing>();
+    for (int j = 0; j < 1000; ++j)
+      sub.add<Rectangle>(i, j, 25, 50);
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  auto first = doc.publish();
+  std::chrono::duration<double, std::micro> full = std::chrono::steady_clock::now() - t0;
+
+
+  // The render thread reads snapshots while the writer keeps recolouring
+  // and scaling sub-drawings.
+  std::atomic<bool> done = false;
+  std::size_t frames = 0, bad = 0;
+
+  std::thread render([&] {
+    Document::Reader reader(doc);
+    while (!done)
+    {
+      auto &snap = reader.snapshot();
+      Consistent check;
+      check(snap);
+      bad += !check.ok() || check.shapes() != 1000000;
+      ++frames;
+    }
+  });
+
+  std::size_t edits = 0, copied = 0;
+  double publish_us = 0;
+  for (Color c = 0; c < 2000; ++c)
+  {
+    std::size_t i = c * 7919 % 1000;
+    doc.apply({i}, FillColor(c));
+    if (c % 3 == 0)
+      doc.apply({i}, Scale(c % 2 ? 1.5f : 0.5f));
+
+    auto t0 = std::chrono::steady_clock::now();
+    copied += doc.publish();
+    publish_us += std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - t0).count();
+    ++edits;
+  }
+
+  done = true;
+  render.join();
+
+  std::cout << "first publish: " << first << " shapes, " << full.count() << " us\n"
+            << "edits: " << edits << ", " << copied / edits << " shapes and "
+            << publish_us / edits << " us per publish\n"
+            << "render frames: " << frames << ", inconsistent: " << bad << '\n'
+            << "snapshots still retired: " << doc.retired()
+            << ", std::atomic<std::shared_ptr> lock-free here: " << std::boolalpha
+            << std::atomic<std::shared_ptr<const Snapshot>>().is_lock_free() << '\n';
+
+  return 0;
+}
@@ -0,0 +1,309 @@
+/*
+clang++ -std=c++20 -O2 shape18.cc \
+*/
+
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <random>
+#include <chrono>
+#include <unordered_set>
+#include <initializer_list>
+#include <cstdint>
+
+
+//=========================================================
+// A persistent Composite. The children live in an immutable, reference
+// counted node, so copying a Composite copies one pointer. Any change
+// first makes a private copy of the node if it is shared ("copy on
+// write"); since children are Composites too, an edit deep in the tree
+// copies only the nodes on the path to it and shares everything else.
+//
+// Do not keep references to children across a copy: use update() to
+// reach a sub-drawing instead.
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  Composite() : m_node(std::make_shared<Node>()) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  void emplace_back(A&&... a)
+  {
+    node().emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+  }
+
+  void set(std::size_t i, value_type v) { node()[i] = std::move(v); }
+  void erase(std::size_t i) { node().erase(node().begin() + i); }
+
+  const value_type &operator[](std::size_t i) const { return shared()[i]; }
+  std::size_t size() const { return shared().size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Calls f with the sub-drawing at 'path', copying the nodes on the way.
+  template<typename F>
+  void update(std::initializer_list<std::size_t> path, F f)
+  {
+    Composite *c = this;
+    for (auto i : path)
+      c = &std::get<Composite>(c->node()[i]);
+    f(*c);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // A visitor that changes shapes copies what it visits; one that only
+  // reads should be applied to a const Composite.
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : node())
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+  template <typename T>
+  void accept(T &visitor) const
+  {
+    for (auto &s : shared())
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Adds the bytes of every node not already in 'seen'.
+  void footprint(std::unordered_set<const void*> &seen, std::size_t &bytes) const
+  {
+    if (!seen.insert(m_node.get()).second)
+      return;
+
+    // the vector, its elements and the shared_ptr control block
+    bytes += sizeof(Node) + shared().capacity() * sizeof(value_type) + 16;
+    for (auto &s : shared())
+      if (auto c = std::get_if<Composite>(&s))
+        c->footprint(seen, bytes);
+  }
+
+//---------------------------------------------------------
+private:
+  using Node = std::vector<value_type>;
+
+  // The node, possibly shared with other copies: read only.
+  const Node &shared() const { return *m_node; }
+
+  // The node, made private to this copy first.
+  Node &node()
+  {
+    if (m_node.use_count() > 1)
+      m_node = std::make_shared<Node>(*m_node);
+    return *m_node;
+  }
+
+  std::shared_ptr<Node> m_node;
+};
+
+
+
+//=========================================================
+using Color = std::uint32_t;
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_radius(radius), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+  void setSize(int radius) { m_radius = radius; }
+  Color getFillColor() const { return m_fill; }
+  void setFillColor(Color c) { m_fill = c; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+  Color m_fill;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_len(len), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+  void setSize(int len) { m_len = len; }
+  Color getFillColor() const { return m_fill; }
+  void setFillColor(Color c) { m_fill = c; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+  Color m_fill;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_w(w), m_h(h), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+  void setSize(int w, int h) { m_w = w; m_h = h; }
+  Color getFillColor() const { return m_fill; }
+  void setFillColor(Color c) { m_fill = c; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+  Color m_fill;
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setSize(s.getSize() * m_ratio); }
+  void operator()(Triangle &s) { s.setSize(s.getSize() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    s.setSize(w * m_ratio, h * m_ratio);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+//=========================================================
+class Area {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s) { m_area += 3.14159 * s.getSize() * s.getSize(); }
+  void operator()(const Triangle &s) { m_area += 0.433 * s.getSize() * s.getSize(); }
+
+  void operator()(const Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    m_area += double(w) * h;
+  }
+
+  void operator()(const Drawing &d) { d.accept(*this); }
+
+  double area() const { return m_area; }
+
+//---------------------------------------------------------
+private:
+  double m_area = 0;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+double area(const Drawing &d)
+{
+  Area a;
+  a(d);
+  return a.area();
+}
+
+template<typename F>
+double micro(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main()
+{
+  // 100 sub-drawings of 100 sub-drawings of 100 shapes each.
+  Drawing d;
+  for (std::size_t i = 0; i < 100; ++i)
+  {
+    d.emplace_back<Drawing>();
+    for (std::size_t k = 0; k < 100; ++k)
+    {
+      d.update({i}, [](Drawing &sub) { sub.emplace_back<Drawing>(); });
+      d.update({i, k}, [&](Drawing &sub) {
+        for (int j = 0; j < 100; ++j)
+          sub.emplace_back<Rectangle>(int(i * 100 + k), j, 25, 50);
+      });
+    }
+  }
+
+  std::unordered_set<const void*> seen;
+  std::size_t one = 0;
+  d.footprint(seen, one);
+
+
+  // Keep every state as an undo step.
+  std::vector<Drawing> history;
+  history.push_back(d);
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<std::size_t> pick(0, 99);
+  double edit_us = 0, copy_us = 0;
+  const int edits = 10000;
+
+  for (int n = 0; n < edits; ++n)
+  {
+    auto i = pick(rng), k = pick(rng), j = pick(rng);
+    edit_us += micro([&] {
+      if (n % 100 == 0)
+        d.update({i, k}, Scale(1.5f));
+      else
+        d.update({i, k}, [&](Drawing &sub) {
+          sub.set(j, Circle(int(i * 100 + k), int(j), 5, Color(n)));
+        });
+    });
+    copy_us += micro([&] { history.push_back(d); });
+  }
+
+  std::size_t all = 0;
+  seen.clear();
+  for (auto &h : history)
+    h.footprint(seen, all);
+
+  std::cout << "one state:       " << one / 1024 << " KiB\n"
+            << history.size() << " states:   " << all / 1024 << " KiB"
+            << " (deep copies would take " << one / 1024 * history.size() / 1024
+            << " MiB)\n"
+            << "per edit:        " << edit_us / edits << " us\n"
+            << "per copy:        " << copy_us / edits << " us\n";
+
+  // Undo all the way back.
+  std::cout << "area now " << area(d) << ", area of the first state "
+            << area(history.front()) << " (expected " << 1000.0 * 1000 * 25 * 50
+            << ")\n";
+
+  return 0;
+}
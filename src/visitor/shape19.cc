@@ -0,0 +1,421 @@
+/*
+clang++ -std=c++20 -O3 -march=native -pthread shape19.cc \
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <cstdint>
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto begin() const { return m_shape.begin(); }
+
+  auto end() { return m_shape.end(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+// Every shape is summarised by its bounding box: a circle of radius r is
+// 2r by 2r, a triangle of side len is len by len and its area is
+// k * w * h, with k depending on the type only. The covered w * h is
+// summed exactly in integers per type, so partial results can be merged
+// in any order and still give the same answer.
+enum Type { circle, triangle, rectangle };
+
+constexpr double k_area[] = { 3.14159265358979 / 4, 0.43301270189222, 1.0 };
+const char *type_name[] = { "circle", "triangle", "rectangle" };
+
+struct Stats {
+  std::array<std::int64_t, 3> count{};
+  std::array<std::int64_t, 3> cover{};
+
+  std::int32_t x0 = std::numeric_limits<std::int32_t>::max();
+  std::int32_t y0 = std::numeric_limits<std::int32_t>::max();
+  std::int32_t x1 = std::numeric_limits<std::int32_t>::min();
+  std::int32_t y1 = std::numeric_limits<std::int32_t>::min();
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void add(Type t, int x, int y, int w, int h)
+  {
+    ++count[t];
+    cover[t] += std::int64_t(w) * h;
+    x0 = std::min(x0, x);
+    y0 = std::min(y0, y);
+    x1 = std::max(x1, x + w);
+    y1 = std::max(y1, y + h);
+  }
+
+  Stats &merge(const Stats &s)
+  {
+    for (int t = 0; t < 3; ++t)
+    {
+      count[t] += s.count[t];
+      cover[t] += s.cover[t];
+    }
+    x0 = std::min(x0, s.x0);
+    y0 = std::min(y0, s.y0);
+    x1 = std::max(x1, s.x1);
+    y1 = std::max(y1, s.y1);
+    return *this;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  double area() const
+  {
+    return k_area[circle] * cover[circle] + k_area[triangle] * cover[triangle]
+      + k_area[rectangle] * cover[rectangle];
+  }
+
+  bool operator==(const Stats &) const = default;
+
+  friend std::ostream &operator<<(std::ostream &os, const Stats &s)
+  {
+    os << "area " << std::setprecision(12) << s.area() << std::setprecision(6)
+       << ", bounds (" << s.x0 << ',' << s.y0 << ")-(" << s.x1 << ',' << s.y1 << ')';
+    for (int t = 0; t < 3; ++t)
+      os << ", " << type_name[t] << "s " << s.count[t];
+    return os;
+  }
+};
+
+
+//=========================================================
+// The way we would write it today: one visit per shape.
+class Statistics {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x, y] = s.getPosition();
+    m_stats.add(circle, x, y, 2 * s.getSize(), 2 * s.getSize());
+  }
+
+  void operator()(const Triangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    m_stats.add(triangle, x, y, s.getSize(), s.getSize());
+  }
+
+  void operator()(const Rectangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+    m_stats.add(rectangle, x, y, w, h);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Drawing &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+  const Stats &stats() const { return m_stats; }
+
+//---------------------------------------------------------
+private:
+  Stats m_stats;
+};
+
+
+
+//=========================================================
+// The same shapes packed by type into columns, one per field, so that a
+// reduction is a plain loop over contiguous int32s that the compiler turns
+// into SIMD code. A Packed mirrors the drawing: each sub-drawing has its
+// own columns and its statistics are merged into its parent's.
+struct Column {
+  std::vector<std::int32_t> x, y, w, h;
+
+  std::size_t size() const { return x.size(); }
+
+  void push(int px, int py, int pw, int ph)
+  {
+    x.push_back(px);
+    y.push_back(py);
+    w.push_back(pw);
+    h.push_back(ph);
+  }
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The loop the rest is built on. It has no branches and only reductions
+// the compiler can reorder: integer sums, minima and maxima.
+Stats reduce(const Column &c, Type t, std::size_t from, std::size_t to)
+{
+  const std::int32_t *x = c.x.data(), *y = c.y.data();
+  const std::int32_t *w = c.w.data(), *h = c.h.data();
+
+  std::int64_t cover = 0;
+  std::int32_t x0 = std::numeric_limits<std::int32_t>::max(), y0 = x0;
+  std::int32_t x1 = std::numeric_limits<std::int32_t>::min(), y1 = x1;
+
+  for (std::size_t i = from; i < to; ++i)
+  {
+    cover += std::int64_t(w[i]) * h[i];
+    x0 = std::min(x0, x[i]);
+    y0 = std::min(y0, y[i]);
+    x1 = std::max(x1, x[i] + w[i]);
+    y1 = std::max(y1, y[i] + h[i]);
+  }
+
+  Stats s;
+  s.count[t] = to - from;
+  s.cover[t] = cover;
+  s.x0 = x0; s.y0 = y0;
+  s.x1 = x1; s.y1 = y1;
+  return s;
+}
+
+
+//=========================================================
+class Packed {
+public:
+
+  Packed(const Drawing &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x, y] = s.getPosition();
+    m_column[circle].push(x, y, 2 * s.getSize(), 2 * s.getSize());
+  }
+
+  void operator()(const Triangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    m_column[triangle].push(x, y, s.getSize(), s.getSize());
+  }
+
+  void operator()(const Rectangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+    m_column[rectangle].push(x, y, w, h);
+  }
+
+  void operator()(const Drawing &d) { m_child.emplace_back(d); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The statistics of this drawing and everything below it.
+  Stats stats() const
+  {
+    Stats s;
+    for (int t = 0; t < 3; ++t)
+      s.merge(reduce(m_column[t], Type(t), 0, m_column[t].size()));
+    for (auto &c : m_child)
+      s.merge(c.stats());
+    return s;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The same, split into chunks that 'threads' threads take in turn. Each
+  // thread reduces into its own Stats; they are merged at the end.
+  Stats stats(unsigned threads) const
+  {
+    std::vector<Chunk> chunk;
+    chunks(chunk);
+
+    std::atomic<std::size_t> next = 0;
+    std::vector<Stats> partial(threads);
+    std::vector<std::thread> pool;
+
+    for (unsigned n = 0; n < threads; ++n)
+      pool.emplace_back([&, n] {
+        for (auto i = next++; i < chunk.size(); i = next++)
+          partial[n].merge(reduce(*chunk[i].column, chunk[i].type,
+            chunk[i].from, chunk[i].to));
+      });
+
+    Stats s;
+    for (unsigned n = 0; n < threads; ++n)
+    {
+      pool[n].join();
+      s.merge(partial[n]);
+    }
+    return s;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::size_t bytes() const
+  {
+    std::size_t b = 0;
+    for (auto &c : m_column)
+      b += c.size() * 4 * sizeof(std::int32_t);
+    for (auto &c : m_child)
+      b += c.bytes();
+    return b;
+  }
+
+//---------------------------------------------------------
+private:
+  struct Chunk {
+    const Column *column;
+    Type type;
+    std::size_t from, to;
+  };
+
+  void chunks(std::vector<Chunk> &chunk) const
+  {
+    const std::size_t size = 1 << 16;
+    for (int t = 0; t < 3; ++t)
+      for (std::size_t i = 0; i < m_column[t].size(); i += size)
+        chunk.push_back({&m_column[t], Type(t), i,
+          std::min(i + size, m_column[t].size())});
+    for (auto &c : m_child)
+      c.chunks(chunk);
+  }
+
+  std::array<Column, 3> m_column;
+  std::vector<Packed> m_child;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename F>
+double milli(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+//=========================================================
+int main()
+{
+  // 1000 sub-drawings of 10000 shapes each, in sub-drawings of their own
+  // every so often.
+  Drawing d;
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> pos(-100000, 100000), size(1, 100), type(0, 2);
+
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto &sub = d.add<Drawing>();
+    auto *leaf = &sub;
+    for (int j = 0; j < 10000; ++j)
+    {
+      if (j % 2500 == 0)
+        leaf = &sub.add<Drawing>();
+
+      switch (type(rng))
+      {
+        case circle: leaf->add<Circle>(pos(rng), pos(rng), size(rng)); break;
+        case triangle: leaf->add<Triangle>(pos(rng), pos(rng), size(rng)); break;
+        default: leaf->add<Rectangle>(pos(rng), pos(rng), size(rng), size(rng)); break;
+      }
+    }
+  }
+
+  Statistics plain;
+  auto plain_ms = milli([&] { plain(d); });
+
+  std::unique_ptr<Packed> packed;
+  auto pack_ms = milli([&] { packed = std::make_unique<Packed>(d); });
+
+  Stats simd, mt;
+  unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+  auto simd_ms = milli([&] { simd = packed->stats(); });
+  auto mt_ms = milli([&] { mt = packed->stats(threads); });
+
+  auto rate = [&](double ms) { return packed->bytes() / ms / 1e6; };
+
+  std::cout << plain.stats() << '\n'
+            << std::fixed << std::setprecision(1)
+            << "visitor:             " << std::setw(7) << plain_ms << " ms\n"
+            << "packing:             " << std::setw(7) << pack_ms << " ms, "
+            << packed->bytes() / (1 << 20) << " MiB\n"
+            << "packed:              " << std::setw(7) << simd_ms << " ms, "
+            << rate(simd_ms) << " GB/s\n"
+            << "packed, " << threads << " threads:  " << std::setw(7) << mt_ms
+            << " ms, " << rate(mt_ms) << " GB/s\n"
+            << "results agree:       " << std::boolalpha
+            << (simd == plain.stats() && mt == plain.stats()) << '\n';
+
+  return 0;
+}
@@ -0,0 +1,440 @@
+/*
+clang++ -std=c++20 -O2 shape20.cc \
+*/
+
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <array>
+#include <tuple>
+#include <variant>
+#include <algorithm>
+#include <concepts>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+
+//=========================================================
+// As in SFML, the position of a shape is the top left corner of its
+// bounding box.
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+// Equilateral, pointing up.
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto begin() const { return m_shape.begin(); }
+
+  auto end() { return m_shape.end(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+struct Point { double x, y; };
+
+struct Polygon {
+  std::array<Point, 4> p;
+  int n;
+};
+
+const double sin60 = std::sqrt(3.0) / 2;
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Corners in clockwise order (y grows downwards).
+Polygon corners(const Triangle &s)
+{
+  auto [x, y] = s.getPosition();
+  double len = s.getSize();
+  return {{{{x + len / 2, y + 0.0}, {x + len, y + len * sin60}, {x + 0.0, y + len * sin60}}}, 3};
+}
+
+Polygon corners(const Rectangle &s)
+{
+  auto [x, y] = s.getPosition();
+  auto [w, h] = s.getSize();
+  return {{{{x + 0.0, y + 0.0}, {x + w + 0.0, y + 0.0}, {x + w + 0.0, y + h + 0.0},
+    {x + 0.0, y + h + 0.0}}}, 4};
+}
+
+template<typename T>
+concept Convex = std::same_as<T, Triangle> || std::same_as<T, Rectangle>;
+
+
+//=========================================================
+// The narrow phase. std::visit on two shapes picks the overload for the
+// pair of types from a table built at compile time, so this is the double
+// dispatch. Shapes that only touch do not overlap.
+class Intersects {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool operator()(const Circle &a, const Circle &b)
+  {
+    auto [ax, ay] = a.getPosition();
+    auto [bx, by] = b.getPosition();
+    double ra = a.getSize(), rb = b.getSize();
+    double dx = (ax + ra) - (bx + rb), dy = (ay + ra) - (by + rb);
+    return dx * dx + dy * dy < (ra + rb) * (ra + rb);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The circle overlaps if its centre is inside, or closer than its
+  // radius to an edge.
+  bool operator()(const Circle &a, const Convex auto &b)
+  {
+    auto [x, y] = a.getPosition();
+    double r = a.getSize();
+    Point c{x + r, y + r};
+    auto poly = corners(b);
+
+    bool inside = true;
+    for (int i = 0; i < poly.n; ++i)
+    {
+      auto p = poly.p[i], q = poly.p[(i + 1) % poly.n];
+      double ex = q.x - p.x, ey = q.y - p.y;
+      double cx = c.x - p.x, cy = c.y - p.y;
+
+      inside = inside && ex * cy - ey * cx > 0;
+
+      double t = std::clamp((cx * ex + cy * ey) / (ex * ex + ey * ey), 0.0, 1.0);
+      double dx = cx - t * ex, dy = cy - t * ey;
+      if (dx * dx + dy * dy < r * r)
+        return true;
+    }
+    return inside;
+  }
+
+  bool operator()(const Convex auto &a, const Circle &b) { return (*this)(b, a); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Separating axis test: two convex polygons are apart if the projections
+  // on the normal of one of their edges do not overlap.
+  bool operator()(const Convex auto &a, const Convex auto &b)
+  {
+    auto pa = corners(a), pb = corners(b);
+    return !separated(pa, pb) && !separated(pb, pa);
+  }
+
+  // Sub-drawings are flattened before this is called.
+  bool operator()(const auto &, const Drawing &) { return false; }
+  bool operator()(const Drawing &, const auto &) { return false; }
+  bool operator()(const Drawing &, const Drawing &) { return false; }
+
+//---------------------------------------------------------
+private:
+  static bool separated(const Polygon &a, const Polygon &b)
+  {
+    for (int i = 0; i < a.n; ++i)
+    {
+      auto p = a.p[i], q = a.p[(i + 1) % a.n];
+      double nx = p.y - q.y, ny = q.x - p.x;
+
+      auto [a0, a1] = project(a, nx, ny);
+      auto [b0, b1] = project(b, nx, ny);
+      if (a1 <= b0 || b1 <= a0)
+        return true;
+    }
+    return false;
+  }
+
+  static std::tuple<double, double> project(const Polygon &a, double nx, double ny)
+  {
+    double lo = a.p[0].x * nx + a.p[0].y * ny, hi = lo;
+    for (int i = 1; i < a.n; ++i)
+    {
+      double d = a.p[i].x * nx + a.p[i].y * ny;
+      lo = std::min(lo, d);
+      hi = std::max(hi, d);
+    }
+    return {lo, hi};
+  }
+};
+
+
+//=========================================================
+// Finds all pairs of overlapping shapes in a drawing, at any depth.
+//
+// The broad phase puts the bounding box of every shape into the cells of a
+// uniform grid that it covers, and only tests shapes that share a cell.
+// A pair can share several cells; it is only tested in the cell holding
+// the top left corner of the intersection of the two boxes.
+class Overlaps {
+public:
+
+  Overlaps(const Drawing &d)
+  {
+    (*this)(d);
+    if (m_box.empty())
+      return;
+
+    // Cells about twice the size of an average shape, and not many more
+    // cells than shapes.
+    double extent = 0;
+    for (auto &b : m_box)
+      extent += (b.x1 - b.x0) + (b.y1 - b.y0);
+    m_cell = std::max(1.0, extent / m_box.size());
+    while ((m_x1 - m_x0) / m_cell * (m_y1 - m_y0) / m_cell > 4.0 * m_box.size())
+      m_cell *= 2;
+
+    m_nx = int((m_x1 - m_x0) / m_cell) + 1;
+    m_ny = int((m_y1 - m_y0) / m_cell) + 1;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x, y] = s.getPosition();
+    add(x, y, 2 * s.getSize(), 2 * s.getSize());
+  }
+
+  void operator()(const Triangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    add(x, y, s.getSize(), std::ceil(s.getSize() * sin60));
+  }
+
+  void operator()(const Rectangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+    add(x, y, w, h);
+  }
+
+  void operator()(const Drawing &d)
+  {
+    for (auto &s : d)
+    {
+      m_current = &s;
+      std::visit(*this, s);
+    }
+  }
+
+  std::size_t size() const { return m_shape.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Calls f(a, b) once for every pair of overlapping shapes.
+  template<typename F>
+  void each(F f) const
+  {
+    if (m_shape.empty())
+      return;
+
+    // Bucket the shapes by cell: count, prefix sums, fill.
+    std::vector<std::uint32_t> first(std::size_t(m_nx) * m_ny + 1, 0);
+    for (auto &b : m_box)
+      for (int cy = row(b.y0); cy <= row(b.y1); ++cy)
+        for (int cx = col(b.x0); cx <= col(b.x1); ++cx)
+          ++first[cy * std::size_t(m_nx) + cx + 1];
+
+    for (std::size_t i = 1; i < first.size(); ++i)
+      first[i] += first[i - 1];
+
+    std::vector<std::uint32_t> cell(first.back());
+    auto fill = first;
+    for (std::uint32_t i = 0; i < m_box.size(); ++i)
+    {
+      auto &b = m_box[i];
+      for (int cy = row(b.y0); cy <= row(b.y1); ++cy)
+        for (int cx = col(b.x0); cx <= col(b.x1); ++cx)
+          cell[fill[cy * std::size_t(m_nx) + cx]++] = i;
+    }
+
+    Intersects intersects;
+    for (std::size_t c = 0; c + 1 < first.size(); ++c)
+      for (auto i = first[c]; i < first[c + 1]; ++i)
+        for (auto j = i + 1; j < first[c + 1]; ++j)
+        {
+          auto &a = m_box[cell[i]], &b = m_box[cell[j]];
+          if (a.x1 <= b.x0 || b.x1 <= a.x0 || a.y1 <= b.y0 || b.y1 <= a.y0)
+            continue;
+
+          auto corner = row(std::max(a.y0, b.y0)) * std::size_t(m_nx)
+            + col(std::max(a.x0, b.x0));
+          if (corner != c)
+            continue;
+
+          auto &sa = *m_shape[cell[i]], &sb = *m_shape[cell[j]];
+          if (std::visit(intersects, sa, sb))
+            f(sa, sb);
+        }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Tests every pair, to check each() against.
+  template<typename F>
+  void brute_force(F f) const
+  {
+    Intersects intersects;
+    for (std::size_t i = 0; i < m_shape.size(); ++i)
+      for (std::size_t j = i + 1; j < m_shape.size(); ++j)
+        if (std::visit(intersects, *m_shape[i], *m_shape[j]))
+          f(*m_shape[i], *m_shape[j]);
+  }
+
+//---------------------------------------------------------
+private:
+  struct Box { int x0, y0, x1, y1; };
+
+  void add(int x, int y, int w, int h)
+  {
+    m_shape.push_back(m_current);
+    m_box.push_back({x, y, x + w, y + h});
+    m_x0 = std::min(m_x0, x);
+    m_y0 = std::min(m_y0, y);
+    m_x1 = std::max(m_x1, x + w);
+    m_y1 = std::max(m_y1, y + h);
+  }
+
+  int col(int x) const { return int((x - m_x0) / m_cell); }
+  int row(int y) const { return int((y - m_y0) / m_cell); }
+
+  std::vector<const Shape*> m_shape;
+  std::vector<Box> m_box;
+  const Shape *m_current = nullptr;
+
+  int m_x0 = INT32_MAX, m_y0 = INT32_MAX, m_x1 = INT32_MIN, m_y1 = INT32_MIN;
+  double m_cell = 1;
+  int m_nx = 1, m_ny = 1;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// 'n' shapes spread over a square of side 'side', in sub-drawings of 1000.
+Drawing scatter(int n, int side)
+{
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> pos(0, side), size(1, 50), type(0, 2);
+
+  Drawing d;
+  Drawing *sub = &d;
+  for (int i = 0; i < n; ++i)
+  {
+    if (i % 1000 == 0)
+      sub = &d.add<Drawing>();
+
+    switch (type(rng))
+    {
+      case 0: sub->add<Circle>(pos(rng), pos(rng), size(rng) / 2 + 1); break;
+      case 1: sub->add<Triangle>(pos(rng), pos(rng), size(rng)); break;
+      default: sub->add<Rectangle>(pos(rng), pos(rng), size(rng), size(rng)); break;
+    }
+  }
+  return d;
+}
+
+template<typename F>
+double seconds(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main()
+{
+  // The grid must find exactly the pairs found by testing every pair.
+  {
+    auto d = scatter(5000, 2000);
+    Overlaps overlaps(d);
+
+    using Pair = std::tuple<const Shape*, const Shape*>;
+    std::vector<Pair> grid, brute;
+    auto ordered = [](const Shape &a, const Shape &b) {
+      return std::min(&a, &b) == &a ? Pair{&a, &b} : Pair{&b, &a};
+    };
+
+    overlaps.each([&](const Shape &a, const Shape &b) { grid.push_back(ordered(a, b)); });
+    overlaps.brute_force([&](const Shape &a, const Shape &b) { brute.push_back(ordered(a, b)); });
+    std::sort(grid.begin(), grid.end());
+    std::sort(brute.begin(), brute.end());
+
+    std::cout << "5000 shapes: " << grid.size() << " pairs, "
+              << (grid == brute ? "same as" : "DIFFERENT from") << " brute force\n";
+  }
+
+  // A million shapes, with about as much overlap as above.
+  auto d = scatter(1000000, 28000);
+  std::unique_ptr<Overlaps> overlaps;
+  std::size_t pairs = 0, circles = 0;
+
+  auto collect = seconds([&] { overlaps = std::make_unique<Overlaps>(d); });
+  auto find = seconds([&] {
+    overlaps->each([&](const Shape &a, const Shape &b) {
+      ++pairs;
+      circles += std::holds_alternative<Circle>(a) && std::holds_alternative<Circle>(b);
+    });
+  });
+
+  std::cout << overlaps->size() << " shapes: " << pairs << " pairs ("
+            << circles << " circle/circle), collect " << collect << " s, find "
+            << find << " s\n";
+
+  return 0;
+}
@@ -0,0 +1,548 @@
+/*
+clang++ -std=c++20 -O2 shape21.cc \
+*/
+
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+
+//=========================================================
+// Every shape type gets a small, dense id the first time it is asked for,
+// so types can be added at run time, by plugins, without a list of them
+// anywhere. Ids may be handed out on any thread.
+using TypeId = std::uint32_t;
+
+inline TypeId next_type_id()
+{
+  static std::atomic<TypeId> next = 0;
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename T>
+TypeId type_id()
+{
+  static const TypeId id = next_type_id();
+  return id;
+}
+
+
+//=========================================================
+class Circle;
+class Triangle;
+class Rectangle;
+class Drawing;
+
+//=========================================================
+// The Visitor of shape4.cc, only here to compare against. It has to be
+// edited for every new type.
+class ClassicVisitor {
+public:
+
+  virtual ~ClassicVisitor() {}
+
+  virtual void visit(Circle &s) = 0;
+  virtual void visit(Triangle &s) = 0;
+  virtual void visit(Rectangle &s) = 0;
+  virtual void visit(Drawing &s) = 0;
+};
+
+
+//=========================================================
+class Shape {
+public:
+  virtual ~Shape() {}
+
+  TypeId type() const { return m_type; }
+
+  // Types the ClassicVisitor does not know about are not visited.
+  virtual void accept(ClassicVisitor &) {}
+
+//---------------------------------------------------------
+protected:
+  Shape(TypeId type) : m_type(type) {}
+
+private:
+  TypeId m_type;
+};
+
+//---------------------------------------------------------
+template<typename T>
+class Registered : public Shape {
+protected:
+  Registered() : Shape(type_id<T>()) {}
+};
+
+
+//=========================================================
+// Dispatch is an index into a flat table of handlers, one per type id, and
+// an indirect call: no chain of virtual calls or dynamic_casts. Each
+// visitor keeps the table it was made with; the table never changes once
+// it is published, so dispatch needs no lock.
+class Visitor {
+public:
+  // Calls the callable at 'f' with the visitor and the shape.
+  struct Handler {
+    void (*call)(const void *f, Visitor &, Shape &);
+    const void *f;
+  };
+
+  void operator()(Shape &s)
+  {
+    auto id = s.type();
+    if (id < m_size)
+      m_handlers[id].call(m_handlers[id].f, *this, s);
+  }
+
+//---------------------------------------------------------
+protected:
+  // owned[id] keeps the callable of handlers[id] alive.
+  struct Table {
+    std::vector<Handler> handlers;
+    std::vector<std::shared_ptr<const void>> owned;
+  };
+
+  Visitor(std::shared_ptr<const Table> table)
+    : m_table(std::move(table)), m_handlers(m_table->handlers.data()),
+      m_size(m_table->handlers.size()) {}
+
+private:
+  std::shared_ptr<const Table> m_table;
+  const Handler *m_handlers;
+  std::size_t m_size;
+};
+
+
+//=========================================================
+// The table is shared by all visitors of class V. V::install() adds the
+// types it handles itself; anyone else, e.g. a plugin, can add more
+// through on<T>(f), with f(V &, T &) a function, a lambda or any other
+// callable, or replace a handler of V's own.
+//
+// on<T>() may be called from any thread. It copies the table, adds f and
+// publishes the copy, under a lock; visitors made before that keep the
+// table they have. V::install() runs on the first use of the table,
+// before any other handler is added, so those always take its place.
+template<typename V>
+class Visits : public Visitor {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T>
+  struct Member {
+    void operator()(V &v, T &s) const { v.visit(s); }
+  };
+
+  template<typename T, typename F = Member<T>>
+  static void on(F f = {})
+  {
+    auto &r = registry();
+    std::lock_guard lock(r.mutex);
+    install(r);
+
+    auto next = std::make_shared<Table>(*r.table);
+    auto id = type_id<T>();
+    if (id >= next->handlers.size())
+    {
+      next->handlers.resize(id + 1, {[](const void *, Visitor &, Shape &) {}, nullptr});
+      next->owned.resize(id + 1);
+    }
+
+    auto handler = std::make_shared<const F>(std::move(f));
+    next->handlers[id] = {[](const void *f, Visitor &v, Shape &s) {
+      (*static_cast<const F *>(f))(static_cast<V &>(v), static_cast<T &>(s));
+    }, handler.get()};
+    next->owned[id] = std::move(handler);
+
+    r.table = std::move(next);
+  }
+
+//---------------------------------------------------------
+protected:
+  Visits() : Visitor(table()) {}
+
+private:
+  // The mutex is recursive because V::install() calls on<T>().
+  struct Registry {
+    std::recursive_mutex mutex;
+    std::shared_ptr<const Table> table = std::make_shared<const Table>();
+    bool installed = false;
+  };
+
+  static Registry &registry()
+  {
+    static Registry r;
+    return r;
+  }
+
+  static void install(Registry &r)
+  {
+    if (!std::exchange(r.installed, true))
+      V::install();
+  }
+
+  static std::shared_ptr<const Table> table()
+  {
+    auto &r = registry();
+    std::lock_guard lock(r.mutex);
+    install(r);
+    return r.table;
+  }
+};
+
+
+
+//=========================================================
+class Circle : public Registered<Circle> {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+  void accept(ClassicVisitor &visitor) override { visitor.visit(*this); }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle : public Registered<Triangle> {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+  void accept(ClassicVisitor &visitor) override { visitor.visit(*this); }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle : public Registered<Rectangle> {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+  void accept(ClassicVisitor &visitor) override { visitor.visit(*this); }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+
+//=========================================================
+class Drawing : public Registered<Drawing> {
+public:
+
+  void accept(ClassicVisitor &visitor) override { visitor.visit(*this); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::make_unique<T>(std::forward<A>(a)...));
+    return * static_cast<T*>(tmp.get());
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto end() { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<std::unique_ptr<Shape>> m_shape;
+};
+
+
+
+//=========================================================
+class ToJSON : public Visits<ToJSON> {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  static void install()
+  {
+    on<Circle>();
+    on<Triangle>();
+    on<Rectangle>();
+    on<Drawing>();
+  }
+
+  std::ostream &os() { return m_os; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void visit(Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void visit(Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void visit(Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void visit(Drawing &d)
+  {
+    const char *p = "";
+    const char *postfix = ",\n";
+
+    m_os << "\"drawing\": [\n";
+    for (auto &s : d)
+    {
+      m_os << p;
+      (*this)(*s);
+      p = postfix;
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+//=========================================================
+// Sums the area of the shapes, once for each kind of dispatch.
+class Area : public Visits<Area> {
+public:
+
+  static void install()
+  {
+    on<Circle>();
+    on<Triangle>();
+    on<Rectangle>();
+    on<Drawing>();
+  }
+
+  void visit(Circle &s) { m_area += 3.14159 * s.getSize() * s.getSize(); }
+  void visit(Triangle &s) { m_area += 0.433 * s.getSize() * s.getSize(); }
+
+  void visit(Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    m_area += double(w) * h;
+  }
+
+  void visit(Drawing &d)
+  {
+    for (auto &s : d)
+      (*this)(*s);
+  }
+
+  void add(double a) { m_area += a; }
+  double area() const { return m_area; }
+
+//---------------------------------------------------------
+private:
+  double m_area = 0;
+};
+
+//---------------------------------------------------------
+class ClassicArea : public ClassicVisitor {
+public:
+
+  void visit(Circle &s) override { m_area += 3.14159 * s.getSize() * s.getSize(); }
+  void visit(Triangle &s) override { m_area += 0.433 * s.getSize() * s.getSize(); }
+
+  void visit(Rectangle &s) override
+  {
+    auto [w, h] = s.getSize();
+    m_area += double(w) * h;
+  }
+
+  void visit(Drawing &d) override
+  {
+    for (auto &s : d)
+      s->accept(*this);
+  }
+
+  double area() const { return m_area; }
+
+//---------------------------------------------------------
+private:
+  double m_area = 0;
+};
+
+//---------------------------------------------------------
+class VariantArea {
+public:
+
+  void operator()(Circle &s) { m_area += 3.14159 * s.getSize() * s.getSize(); }
+  void operator()(Triangle &s) { m_area += 0.433 * s.getSize() * s.getSize(); }
+
+  void operator()(Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    m_area += double(w) * h;
+  }
+
+  double area() const { return m_area; }
+
+//---------------------------------------------------------
+private:
+  double m_area = 0;
+};
+
+
+
+//=========================================================
+// What a plugin would provide: a new type, and handlers for it in visitors
+// it did not write. Nothing above changes.
+class Star : public Registered<Star> {
+public:
+
+  Star(int x, int y, int radius, int points)
+    : m_x(x), m_y(y), m_radius(radius), m_points(points) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+  int getPoints() const { return m_points; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius, m_points;
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The inner radius of a star is half the outer one.
+void star_area(Area &area, Star &s)
+{
+  double r = s.getSize(), n = s.getPoints();
+  area.add(n * r * (r / 2) * std::sin(3.14159 / n));
+}
+
+void load_star_plugin()
+{
+  ToJSON::on<Star>([](ToJSON &json, Star &s) {
+    auto [x,y] = s.getPosition();
+
+    json.os() << "\"star\": {\n"
+              << "  \"x\": " << x << ",\n"
+              << "  \"y\": " << y << ",\n"
+              << "  \"radius\": " << s.getSize() << ",\n"
+              << "  \"points\": " << s.getPoints() << "\n}";
+  });
+
+  Area::on<Star>(star_area);
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename F>
+double milli(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+//=========================================================
+int main()
+{
+  load_star_plugin();
+
+  Drawing d;
+  d.add<Circle>(100, 100, 50);
+
+  auto &triangle = d.add<Triangle>(100, 200, 40);
+
+  auto &d1 = d.add<Drawing>();
+  d1.add<Rectangle>(50, 50, 25, 50);
+  d1.add<Star>(75, 75, 25, 5);
+
+  ToJSON json(std::cout);
+  json(d);
+
+
+  // The same five million shapes, visited through each kind of dispatch.
+  const int n = 5000000;
+  Drawing many;
+  std::vector<std::variant<Circle, Triangle, Rectangle>> values;
+  values.reserve(n);
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> size(1, 100), type(0, 2);
+  for (int i = 0; i < n; ++i)
+  {
+    int s = size(rng);
+    switch (type(rng))
+    {
+      case 0: many.add<Circle>(i, i, s); values.emplace_back(Circle(i, i, s)); break;
+      case 1: many.add<Triangle>(i, i, s); values.emplace_back(Triangle(i, i, s)); break;
+      default: many.add<Rectangle>(i, i, s, s); values.emplace_back(Rectangle(i, i, s, s)); break;
+    }
+  }
+
+  Area table;
+  ClassicArea classic;
+  VariantArea variant;
+
+  auto table_ms = milli([&] { table(many); });
+  auto classic_ms = milli([&] { many.accept(classic); });
+  auto variant_ms = milli([&] {
+    for (auto &v : values)
+      std::visit(variant, v);
+  });
+
+  std::cout << "\ndispatch over " << n << " shapes:\n"
+            << "  handler table:        " << table_ms << " ms\n"
+            << "  virtual accept/visit: " << classic_ms << " ms\n"
+            << "  std::visit:           " << variant_ms << " ms (shapes stored by value)\n"
+            << "areas agree: " << std::boolalpha
+            << (table.area() == classic.area() && table.area() == variant.area()) << '\n';
+
+  return 0;
+}
@@ -0,0 +1,263 @@
+/*
+clang++ -std=c++20 -O2 shape22.cc \
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <tuple>
+#include <variant>
+#include <ranges>
+#include <span>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+
+//=========================================================
+// Counts calls to the global operator new, to see how many allocations
+// loading a drawing takes.
+std::size_t allocations = 0;
+
+void *operator new(std::size_t size)
+{
+  ++allocations;
+  if (auto p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The arguments are forwarded as they were passed, and the shape is
+  // constructed in place in the vector.
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Adds one T for each element of 'args': a tuple of constructor
+  // arguments, or a single one. If the number of elements is known up
+  // front the vector grows at most once. It still grows geometrically, so
+  // many small calls do not reallocate every time.
+  template<typename T, typename R>
+  void add_range(R &&args)
+  {
+    if constexpr (std::ranges::sized_range<R>)
+    {
+      auto n = m_shape.size() + std::ranges::size(args);
+      if (n > m_shape.capacity())
+        reserve(std::max(n, 2 * m_shape.capacity()));
+    }
+
+    for (auto &&a : args)
+      emplace<T>(std::forward<decltype(a)>(a));
+  }
+
+  template<typename T, typename I>
+  void add_range(I first, I last)
+  {
+    add_range<T>(std::ranges::subrange(first, last));
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void reserve(std::size_t n) { m_shape.reserve(n); }
+  std::size_t size() const { return m_shape.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto begin() const { return m_shape.begin(); }
+
+  auto end() { return m_shape.end(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  template<typename T, typename E>
+  void emplace(E &&e)
+  {
+    if constexpr (requires { std::tuple_size<std::remove_cvref_t<E>>::value; })
+      std::apply([&](auto &&...a) {
+        m_shape.emplace_back(std::in_place_type<T>, std::forward<decltype(a)>(a)...);
+      }, std::forward<E>(e));
+    else
+      m_shape.emplace_back(std::in_place_type<T>, std::forward<E>(e));
+  }
+
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+class Count {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &) { ++m_shapes; }
+  void operator()(const Triangle &) { ++m_shapes; }
+  void operator()(const Rectangle &) { ++m_shapes; }
+
+  void operator()(const Drawing &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+  std::size_t shapes() const { return m_shapes; }
+
+//---------------------------------------------------------
+private:
+  std::size_t m_shapes = 0;
+};
+
+std::size_t count(const Drawing &d)
+{
+  Count c;
+  c(d);
+  return c.shapes();
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Runs f and prints how long it took and how many allocations it made.
+template<typename F>
+void measure(const char *what, F f)
+{
+  auto n = allocations;
+  auto t0 = std::chrono::steady_clock::now();
+  auto shapes = f();
+  std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
+
+  std::cout << std::left << std::setw(32) << what << std::right
+            << std::setw(10) << shapes << " shapes, "
+            << std::setw(4) << allocations - n << " allocations, "
+            << std::fixed << std::setprecision(1) << std::setw(7) << ms.count() << " ms\n";
+}
+
+
+//=========================================================
+int main()
+{
+  const int n = 10000000;
+
+  // One shape at a time, letting the vector grow as it needs to.
+  measure("add()", [&] {
+    Drawing d;
+    for (int i = 0; i < n; ++i)
+      d.add<Circle>(i, i, 5);
+    return count(d);
+  });
+
+  // The same, with the size known up front.
+  measure("reserve() + add()", [&] {
+    Drawing d;
+    d.reserve(n);
+    for (int i = 0; i < n; ++i)
+      d.add<Circle>(i, i, 5);
+    return count(d);
+  });
+
+  // From a lazy range of argument tuples: nothing is stored but the shapes.
+  measure("add_range(view of tuples)", [&] {
+    Drawing d;
+    d.add_range<Circle>(std::views::iota(0, n)
+      | std::views::transform([](int i) { return std::tuple(i, i, 5); }));
+    return count(d);
+  });
+
+  // From arguments that were loaded earlier, e.g. read from a file.
+  std::vector<std::tuple<int, int, int, int>> loaded;
+  loaded.reserve(n);
+  for (int i = 0; i < n; ++i)
+    loaded.emplace_back(i, i, 25, 50);
+
+  measure("add_range(span of tuples)", [&] {
+    Drawing d;
+    d.add_range<Rectangle>(std::span(loaded));
+    return count(d);
+  });
+
+  // Many small ranges into one drawing.
+  measure("add_range() 10 at a time", [&] {
+    Drawing d;
+    for (int k = 0; k < n; k += 10)
+      d.add_range<Rectangle>(loaded.begin() + k, loaded.begin() + k + 10);
+    return count(d);
+  });
+
+  // 1000 sub-drawings: one allocation for the root and one for each.
+  measure("add_range() in 1000 sub-drawings", [&] {
+    Drawing d;
+    d.reserve(1000);
+    for (int k = 0; k < 1000; ++k)
+    {
+      auto &sub = d.add<Drawing>();
+      sub.add_range<Rectangle>(loaded.begin() + k * (n / 1000),
+        loaded.begin() + (k + 1) * (n / 1000));
+    }
+    return count(d);
+  });
+
+  return 0;
+}
@@ -0,0 +1,565 @@
+/*
+clang++ -std=c++20 -O2 shape23.cc \
+  -I ~/opt/include \
+  -L ~/opt/lib -lsfml-graphics -lsfml-window -lsfml-system
+
+  Press <+>/<-> to zoom in and out and <Esc> to close the graphic window.
+  Run with --headless to only run the check against a fake target.
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+
+#include <SFML/Graphics.hpp>
+
+
+//=========================================================
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &emplace_back(A&&... a)
+  {
+    auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
+      std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  void reserve(std::size_t n) { m_composite.reserve(n); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : m_composite)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<value_type> m_composite;
+};
+
+
+
+//===================================================================
+using Color = sf::Color;
+using Pos = sf::Vector2f;
+using V2f = sf::Vector2f;
+
+using Circle = sf::CircleShape;
+using Rectangle = sf::RectangleShape;
+
+//---------------------------------------------------------
+class Triangle : public Circle {
+public:
+  Triangle(float radius) : Circle (radius, 3) {}
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+//=========================================================
+// What a sub-drawing looks like from far away: its bounding box, filled
+// with the average colour of its shapes weighted by their area.
+class Proxy {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void add(float x, float y, float w, float h, const Color &c)
+  {
+    extend(x, y, x + w, y + h);
+
+    double a = double(w) * h;
+    m_area += a;
+    m_r += a * c.r;
+    m_g += a * c.g;
+    m_b += a * c.b;
+    ++m_shapes;
+  }
+
+  void add(const Proxy &p)
+  {
+    if (p.m_shapes == 0)
+      return;
+
+    extend(p.m_left, p.m_top, p.m_right, p.m_bottom);
+    m_area += p.m_area;
+    m_r += p.m_r;
+    m_g += p.m_g;
+    m_b += p.m_b;
+    m_shapes += p.m_shapes;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Makes the rectangle that is drawn in place of the sub-drawing.
+  void finish()
+  {
+    m_shape.setPosition(Pos(m_left, m_top));
+    m_shape.setSize(V2f{m_right - m_left, m_bottom - m_top});
+    m_shape.setFillColor(color());
+  }
+
+  const Rectangle &shape() const { return m_shape; }
+
+  Pos position() const { return Pos(m_left, m_top); }
+  V2f extent() const { return V2f{m_right - m_left, m_bottom - m_top}; }
+  float size() const { return std::max(m_right - m_left, m_bottom - m_top); }
+  std::size_t shapes() const { return m_shapes; }
+
+  Color color() const
+  {
+    if (m_area == 0)
+      return Color::Transparent;
+    return Color(m_r / m_area, m_g / m_area, m_b / m_area);
+  }
+
+//---------------------------------------------------------
+private:
+  void extend(float left, float top, float right, float bottom)
+  {
+    if (m_shapes == 0)
+    {
+      m_left = left; m_top = top;
+      m_right = right; m_bottom = bottom;
+      return;
+    }
+    m_left = std::min(m_left, left);
+    m_top = std::min(m_top, top);
+    m_right = std::max(m_right, right);
+    m_bottom = std::max(m_bottom, bottom);
+  }
+
+  float m_left = 0, m_top = 0, m_right = 0, m_bottom = 0;
+  double m_area = 0, m_r = 0, m_g = 0, m_b = 0;
+  std::size_t m_shapes = 0;
+  Rectangle m_shape;
+};
+
+
+//=========================================================
+// Builds the proxy of a sub-drawing the first time it is asked for, from
+// the proxies of its own sub-drawings, and keeps it. The shapes in these
+// examples are only ever positioned, so a bounding box is the position and
+// the size. Whatever changes a drawing must clear() the cache.
+class Proxies {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  const Proxy &operator()(Drawing &d)
+  {
+    auto it = m_proxy.find(&d);
+    if (it != m_proxy.end())
+      return it->second;
+
+    Summary summary(*this);
+    d.accept(summary);
+    summary.proxy.finish();
+    return m_proxy.emplace(&d, summary.proxy).first->second;
+  }
+
+  void clear() { m_proxy.clear(); }
+
+//---------------------------------------------------------
+private:
+  struct Summary {
+    Proxies &proxies;
+    Proxy proxy;
+
+    Summary(Proxies &p) : proxies(p) {}
+
+    void operator()(Circle &s)
+    {
+      auto d = 2 * s.getRadius();
+      proxy.add(s.getPosition().x, s.getPosition().y, d, d, s.getFillColor());
+    }
+
+    void operator()(Triangle &s) { (*this)(static_cast<Circle &>(s)); }
+
+    void operator()(Rectangle &s)
+    {
+      auto sz = s.getSize();
+      proxy.add(s.getPosition().x, s.getPosition().y, sz.x, sz.y, s.getFillColor());
+    }
+
+    void operator()(Drawing &d) { proxy.add(proxies(d)); }
+  };
+
+  std::unordered_map<const Drawing *, Proxy> m_proxy;
+};
+
+
+
+//---------------------------------------------------------
+class Window : public sf::RenderWindow {
+public:
+  Window(const int width, const int height, const std::string &title)
+    : sf::RenderWindow(sf::VideoMode(width, height), title.c_str())
+  {
+    setVerticalSyncEnabled(true);
+  }
+};
+
+
+//---------------------------------------------------------
+// Stands in for a Window in tests: replays a list of events and counts
+// what would have been drawn. Closes itself when it runs out of events.
+class FakeTarget {
+public:
+
+  FakeTarget(std::deque<sf::Event> events = {}) : m_event(std::move(events)) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool isOpen() const { return m_open; }
+  void close() { m_open = false; }
+
+  bool pollEvent(sf::Event &) { return false; }
+  bool waitEvent(sf::Event &event)
+  {
+    if (m_event.empty())
+    {
+      close();
+      return false;
+    }
+
+    event = m_event.front();
+    m_event.pop_front();
+    return true;
+  }
+
+  sf::Vector2u getSize() const { return {800, 600}; }
+  void setView(const sf::View &) {}
+
+  void clear() {}
+  void draw(const sf::Drawable &) { ++m_draws; }
+  void display() { ++m_frames; }
+
+  int frames() const { return m_frames; }
+  int draws() const { return m_draws; }
+
+//---------------------------------------------------------
+private:
+  std::deque<sf::Event> m_event;
+  bool m_open = true;
+  int m_draws = 0, m_frames = 0;
+};
+
+
+//=========================================================
+// Draws a drawing on any Target with the RenderWindow interface. A
+// sub-drawing that would be less than 'threshold' pixels across is drawn
+// as its proxy, with one draw call instead of one per shape.
+template<typename Target>
+class Viewer {
+public:
+
+  Viewer(Target &target, float threshold = 4) : m_target(target), m_threshold(threshold) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { m_target.draw(s); }
+  void operator()(Triangle &s) { m_target.draw(s); }
+  void operator()(Rectangle &s) { m_target.draw(s); }
+
+  void operator()(Drawing &d)
+  {
+    auto &proxy = m_proxies(d);
+    if (proxy.size() * m_zoom < m_threshold)
+      m_target.draw(proxy.shape());
+    else
+      d.accept(*this);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Pixels per drawing unit.
+  void zoom(float zoom)
+  {
+    m_zoom = zoom;
+    auto size = m_target.getSize();
+    m_target.setView(sf::View(sf::FloatRect(0, 0, size.x / zoom, size.y / zoom)));
+  }
+
+  Proxies &proxies() { return m_proxies; }
+
+  void frame(Drawing &d)
+  {
+    m_target.clear();
+    (*this)(d);
+    m_target.display();
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void show(Drawing &d)
+  {
+    bool dirty = true;
+    while (m_target.isOpen())
+    {
+      sf::Event event;
+      if (!dirty && m_target.waitEvent(event))
+        dirty = handle(event);
+
+      while (m_target.pollEvent(event))
+        dirty = handle(event) || dirty;
+
+      if (dirty && m_target.isOpen())
+      {
+        frame(d);
+        dirty = false;
+      }
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  bool handle(const sf::Event &event)
+  {
+    switch(event.type)
+    {
+      case sf::Event::Closed: m_target.close(); break;
+      case sf::Event::Resized:
+      case sf::Event::GainedFocus: return true;
+      case sf::Event::KeyPressed:
+        switch (event.key.code)
+        {
+          case sf::Keyboard::Escape: m_target.close(); break;
+          case sf::Keyboard::Add: zoom(m_zoom * 1.25f); return true;
+          case sf::Keyboard::Subtract: zoom(m_zoom * 0.8f); return true;
+          default: break;
+        }
+      break;
+
+      default: break;
+    }
+    return false;
+  }
+
+  Target &m_target;
+  Proxies m_proxies;
+  float m_threshold;
+  float m_zoom = 1;
+};
+
+
+//=========================================================
+// With a 'min_size', sub-drawings smaller than that are written as a
+// summary of their proxy instead of shape by shape.
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os, Proxies &proxies, float min_size = 0)
+    : m_os(os), m_proxies(proxies), m_min_size(min_size) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { shape("circle", s); }
+  void operator()(Triangle &s) { shape("triangle", s); }
+
+  void operator()(Rectangle &s)
+  {
+    auto [x, y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    next();
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << ",\n"
+         << "  \"color\": " << s.getFillColor().toInteger() << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d)
+  {
+    auto &proxy = m_proxies(d);
+    next();
+    if (proxy.size() < m_min_size)
+    {
+      auto [x, y] = proxy.position();
+      auto [w, h] = proxy.extent();
+
+      m_os << "\"summary\": {\n"
+           << "  \"x\": " << x << ",\n"
+           << "  \"y\": " << y << ",\n"
+           << "  \"w\": " << w << ",\n"
+           << "  \"h\": " << h << ",\n"
+           << "  \"color\": " << proxy.color().toInteger() << ",\n"
+           << "  \"shapes\": " << proxy.shapes() << "\n}";
+      return;
+    }
+
+    m_os << "\"drawing\": [\n";
+    m_first = true;
+    d.accept(*this);
+    m_first = false;
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  void next()
+  {
+    if (!m_first)
+      m_os << ",\n";
+    m_first = false;
+  }
+
+  void shape(const char *name, const Circle &s)
+  {
+    auto [x, y] = s.getPosition();
+
+    next();
+    m_os << '"' << name << "\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << s.getRadius() << ",\n"
+         << "  \"color\": " << s.getFillColor().toInteger() << "\n}";
+  }
+
+  std::ostream &m_os;
+  Proxies &m_proxies;
+  float m_min_size;
+  bool m_first = true;
+};
+
+
+//---------------------------------------------------------
+// Counts what is written to it, and throws it away.
+class CountBuf : public std::streambuf {
+public:
+  std::size_t size() const { return m_size; }
+
+//---------------------------------------------------------
+protected:
+  int_type overflow(int_type c) override { ++m_size; return traits_type::not_eof(c); }
+
+  std::streamsize xsputn(const char *, std::streamsize n) override
+  {
+    m_size += n;
+    return n;
+  }
+
+private:
+  std::size_t m_size = 0;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A map of 50 x 40 clusters of 500 small circles, each cluster about 20
+// units across and in a sub-drawing of its own.
+void clusters(Drawing &d)
+{
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> offset(0, 20), radius(0.2f, 1.f);
+  std::uniform_int_distribution<int> channel(0, 255);
+
+  auto &map = d.emplace_back<Drawing>();
+  map.reserve(2000);
+  for (int k = 0; k < 2000; ++k)
+  {
+    auto &cluster = map.emplace_back<Drawing>();
+    cluster.reserve(500);
+    for (int i = 0; i < 500; ++i)
+    {
+      auto &c = cluster.emplace_back<Circle>(radius(rng));
+      c.setPosition(Pos((k % 50) * 40 + offset(rng), (k / 50) * 40 + offset(rng)));
+      c.setFillColor(Color(channel(rng), channel(rng), 0));
+    }
+  }
+}
+
+template<typename F>
+double milli(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main(int argc, char *argv[])
+{
+  Drawing d;
+  auto & circle = d.emplace_back<Circle>(50.f);
+  circle.setFillColor(Color::Red);
+  circle.setPosition(Pos(100,100));
+
+  auto &triangle = d.emplace_back<Triangle>(50.f);
+  triangle.setPosition(Pos(100,200));
+  triangle.setFillColor(Color::Green);
+
+  auto &d1 = d.emplace_back<Drawing>();
+  auto &r1 = d1.emplace_back<Rectangle>(V2f{25, 50});
+  r1.setPosition(Pos(50,50));
+
+  auto &r2 = d1.emplace_back<Rectangle>(V2f{25, 50});
+  r2.setPosition(Pos(75, 75));
+  r2.setFillColor(Color::Blue);
+
+  clusters(d);
+
+
+  // Headless: the cost of a frame at a few zoom levels. From 0.2 pixels
+  // per unit a cluster is 4 pixels across and drawn as one rectangle.
+  FakeTarget fake;
+  Viewer<FakeTarget> headless(fake);
+  bool ok = true;
+
+  auto first = milli([&] { headless.frame(d); });
+  std::cout << "first frame, building the proxies: " << first << " ms\n";
+
+  for (float zoom : {1.f, 0.5f, 0.25f, 0.15f, 0.05f, 0.001f})
+  {
+    headless.zoom(zoom);
+    auto draws = fake.draws();
+    auto ms = milli([&] { headless.frame(d); });
+    draws = fake.draws() - draws;
+
+    std::cout << "zoom " << std::setw(5) << zoom << ": " << std::setw(7) << draws
+              << " draws, " << ms << " ms\n";
+
+    if (zoom == 1.f)
+      ok = ok && draws == 1000004;
+    if (zoom == 0.15f)
+      ok = ok && draws == 2004;
+  }
+
+  // Exports: everything, and clusters smaller than 30 units summarised.
+  CountBuf full, summary;
+  std::ostream os_full(&full), os_summary(&summary);
+
+  ToJSON json(os_full, headless.proxies());
+  json(d);
+  ToJSON summarized(os_summary, headless.proxies(), 30);
+  summarized(d);
+
+  std::cout << "export: " << full.size() / 1024 << " KiB, summarized: "
+            << summary.size() / 1024 << " KiB\n";
+
+  if (argc > 1 && std::string(argv[1]) == "--headless")
+    return ok ? 0 : 1;
+
+
+  Window window(800, 600, "visitor");
+  Viewer<Window> viewer(window);
+  viewer.show(d);
+
+  return 0;
+}
@@ -0,0 +1,799 @@
+/*
+clang++ -std=c++20 -O2 shape24.cc \
+*/
+
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <chrono>
+
+
+//=========================================================
+// The persistent Composite of shape18.cc, with a few more edits. Two
+// versions of a drawing share every sub-drawing that did not change, so
+// id() tells if two sub-drawings are the same without looking inside.
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  Composite() : m_node(std::make_shared<Node>()) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  void emplace_back(A&&... a)
+  {
+    node().emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+  }
+
+  void insert(std::size_t i, value_type v) { node().insert(node().begin() + i, std::move(v)); }
+  void set(std::size_t i, value_type v) { node()[i] = std::move(v); }
+  void erase(std::size_t i) { node().erase(node().begin() + i); }
+
+  void move(std::size_t from, std::size_t to)
+  {
+    auto v = std::move(node()[from]);
+    erase(from);
+    insert(to, std::move(v));
+  }
+
+  const value_type &operator[](std::size_t i) const { return shared()[i]; }
+  std::size_t size() const { return shared().size(); }
+  const void *id() const { return m_node.get(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Calls f with the sub-drawing at 'path', copying the nodes on the way.
+  template<typename P, typename F>
+  void update(const P &path, F f)
+  {
+    Composite *c = this;
+    for (auto i : path)
+      c = &std::get<Composite>(c->node()[i]);
+    f(*c);
+  }
+
+  template<typename F>
+  void update(std::initializer_list<std::size_t> path, F f)
+  {
+    update<std::initializer_list<std::size_t>>(path, f);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : node())
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+  template <typename T>
+  void accept(T &visitor) const
+  {
+    for (auto &s : shared())
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  using Node = std::vector<value_type>;
+
+  // The node, possibly shared with other copies: read only.
+  const Node &shared() const { return *m_node; }
+
+  // The node, made private to this copy first.
+  Node &node()
+  {
+    if (m_node.use_count() > 1)
+      m_node = std::make_shared<Node>(*m_node);
+    return *m_node;
+  }
+
+  std::shared_ptr<Node> m_node;
+};
+
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+  void setSize(int radius) { m_radius = radius; }
+
+  bool operator==(const Circle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+  void setSize(int len) { m_len = len; }
+
+  bool operator==(const Triangle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+  void setSize(int w, int h) { m_w = w; m_h = h; }
+
+  bool operator==(const Rectangle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+using Shape = Drawing::value_type;
+
+
+//=========================================================
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Drawing &d)
+  {
+    m_os << "\"drawing\": [\n";
+    for (std::size_t i = 0; i < d.size(); ++i)
+    {
+      if (i)
+        m_os << ",\n";
+      std::visit(*this, d[i]);
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setSize(s.getSize() * m_ratio); }
+  void operator()(Triangle &s) { s.setSize(s.getSize() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    s.setSize(w * m_ratio, h * m_ratio);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+
+
+//=========================================================
+// One step of a patch. Steps are applied in order, and 'index' and 'to'
+// are positions in the sub-drawing at 'path' at the time the step is
+// applied.
+struct Edit {
+  enum Kind { insert, remove, move, set };
+
+  Kind kind;
+  std::vector<std::size_t> path;
+  std::size_t index, to = 0;
+  std::optional<Shape> shape;
+};
+
+using Patch = std::vector<Edit>;
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+void apply_patch(Drawing &d, const Patch &patch)
+{
+  for (auto &e : patch)
+    d.update(e.path, [&](Drawing &sub) {
+      switch (e.kind)
+      {
+        case Edit::insert: sub.insert(e.index, *e.shape); break;
+        case Edit::remove: sub.erase(e.index); break;
+        case Edit::move: sub.move(e.index, e.to); break;
+        case Edit::set: sub.set(e.index, *e.shape); break;
+      }
+    });
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// One JSON object per line.
+void write(std::ostream &os, const Patch &patch)
+{
+  const char *name[] = { "insert", "remove", "move", "set" };
+  ToJSON json(os);
+
+  for (auto &e : patch)
+  {
+    os << "{\"op\": \"" << name[e.kind] << "\", \"path\": [";
+    for (std::size_t i = 0; i < e.path.size(); ++i)
+      os << (i ? "," : "") << e.path[i];
+    os << "], \"index\": " << e.index;
+
+    if (e.kind == Edit::move)
+      os << ", \"to\": " << e.to;
+    if (e.shape)
+    {
+      os << ", ";
+      std::visit(json, *e.shape);
+    }
+    os << "}\n";
+  }
+}
+
+
+//=========================================================
+// Compares two drawings and returns the patch that turns the first into
+// the second.
+//
+// Sub-drawings shared by both are skipped at once. Elsewhere, the common
+// head and tail of each pair of lists are skipped; what is left in the
+// middle is matched up by content, and what cannot be matched is removed,
+// inserted, or, for a sub-drawing in the place of a sub-drawing, diffed in
+// turn. Content hashes of sub-drawings are computed once per diff.
+class Diff {
+public:
+
+  Patch operator()(const Drawing &a, const Drawing &b)
+  {
+    Patch patch;
+    std::vector<std::size_t> path;
+    diff(a, b, path, patch);
+    m_hash.clear();
+    return patch;
+  }
+
+  std::size_t hashed() const { return m_hashed; }
+
+//---------------------------------------------------------
+private:
+  void diff(const Drawing &a, const Drawing &b, std::vector<std::size_t> &path,
+    Patch &patch)
+  {
+    if (a.id() == b.id())
+      return;
+
+    std::size_t lo = 0, na = a.size(), nb = b.size();
+    while (lo < na && lo < nb && same(a[lo], b[lo]))
+      ++lo;
+    while (na > lo && nb > lo && same(a[na - 1], b[nb - 1]))
+      --na, --nb;
+
+    // Match what is left: sub-drawings by identity and shapes by value
+    // first, then the sub-drawings still unmatched by content, so that
+    // subtrees shared by both drawings are never hashed. from[j] is the old
+    // position of the new shape j, or -1.
+    std::vector<long> from(nb - lo, -1);
+    std::vector<bool> used(na, false), changed(nb - lo, false);
+
+    match(a, b, lo, na, nb, from, used, [&](const Shape &s, std::size_t &key) {
+      if (auto d = std::get_if<Drawing>(&s))
+        key = std::hash<const void *>()(d->id());
+      else
+        key = hash(s);
+      return true;
+    });
+
+    match(a, b, lo, na, nb, from, used, [&](const Shape &s, std::size_t &key) {
+      if (!is_drawing(s))
+        return false;
+      key = hash(s);
+      return true;
+    });
+
+    // Pair the rest, sub-drawings with sub-drawings and shapes with shapes:
+    // these are modified rather than removed and inserted. A new shape is
+    // only paired with an old one that lies between the old positions of
+    // its matched neighbours, so that one removal does not shift every
+    // pair after it. The neighbour after comes from a backward pass, the
+    // one before is carried along, and Unused finds the first old shape
+    // of the right kind past it without rescanning the used ones.
+    std::vector<long> after(nb - lo);
+    for (long next = na, k = nb - lo; k-- > 0; )
+    {
+      after[k] = next;
+      if (from[k] >= 0)
+        next = from[k];
+    }
+
+    // unused[1] holds the old sub-drawings, unused[0] the other shapes.
+    Unused unused[2] = {{lo, na}, {lo, na}};
+    for (auto i = lo; i < na; ++i)
+    {
+      unused[is_drawing(a[i])].take(i, used[i]);
+      unused[!is_drawing(a[i])].take(i, true);
+    }
+
+    long before = long(lo) - 1;
+    for (auto j = lo; j < nb; ++j)
+    {
+      auto k = j - lo;
+      if (from[k] < 0)
+      {
+        auto &u = unused[is_drawing(b[j])];
+        auto i = u.first(before + 1);
+        if (i >= after[k])
+          continue;
+
+        from[k] = i;
+        used[i] = true;
+        changed[k] = true;
+        u.take(i, true);
+      }
+      before = from[k];
+    }
+
+    // Remove from the back so that the positions in front stay valid.
+    for (auto i = na; i-- > lo; )
+      if (!used[i])
+        patch.push_back({Edit::remove, path, i, 0, std::nullopt});
+
+    // What is left is in the old order. The longest run of it that is in
+    // the new order as well stays where it is, and everything else is
+    // moved, in the new order, to just after the shape that comes before
+    // it: the fewest moves there can be.
+    std::vector<long> kept;
+    for (auto f : from)
+      if (f >= 0)
+        kept.push_back(f);
+    moves(kept, increasing(kept), lo, path, patch);
+
+    // Now the new shapes go in at their final positions, from the front,
+    // and then the shapes that were paired up are changed in place.
+    for (auto j = lo; j < nb; ++j)
+      if (from[j - lo] < 0)
+        patch.push_back({Edit::insert, path, j, 0, b[j]});
+
+    for (auto j = lo; j < nb; ++j)
+    {
+      auto k = j - lo;
+      if (!changed[k])
+        continue;
+
+      if (is_drawing(b[j]))
+      {
+        path.push_back(j);
+        diff(std::get<Drawing>(a[from[k]]), std::get<Drawing>(b[j]), path, patch);
+        path.pop_back();
+      }
+      else
+        patch.push_back({Edit::set, path, j, 0, b[j]});
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The old positions in [lo, na) not yet taken: first(i) is the first
+  // one from i on, or na. Taken positions point past themselves, and the
+  // pointers are shortened as they are followed.
+  class Unused {
+  public:
+    Unused(std::size_t lo, std::size_t na) : m_lo(lo), m_next(na - lo + 1)
+    {
+      for (std::size_t i = 0; i < m_next.size(); ++i)
+        m_next[i] = i;
+    }
+
+    void take(std::size_t i, bool taken) { if (taken) m_next[i - m_lo] = i - m_lo + 1; }
+
+    long first(long i)
+    {
+      std::size_t at = std::max<long>(i, m_lo) - m_lo, end = at;
+      while (m_next[end] != end)
+        end = m_next[end];
+      while (m_next[at] != end)
+        at = std::exchange(m_next[at], end);
+      return m_lo + end;
+    }
+
+  private:
+    std::size_t m_lo;
+    std::vector<std::size_t> m_next;
+  };
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Emits the moves that put the shapes at old positions 'kept', which are
+  // in the old order, into the order of 'kept'; those marked in 'stays'
+  // are not moved.
+  //
+  // While this goes on, the list is made of the shapes that stay, each
+  // followed by the shapes already moved in behind it, in the new order,
+  // and then by the shapes still waiting to be moved from there, in the
+  // old order. So every shape has two fixed slots, where it waits and
+  // where it is moved to, and a Fenwick tree over the slots that are
+  // taken gives its position in O(log n).
+  static void moves(const std::vector<long> &kept, const std::vector<bool> &stays,
+    std::size_t lo, const std::vector<std::size_t> &path, Patch &patch)
+  {
+    // The old positions of the shapes that stay, in order, mark the gaps.
+    std::vector<long> stayers;
+    for (std::size_t k = 0; k < kept.size(); ++k)
+      if (stays[k])
+        stayers.push_back(kept[k]);
+
+    // Each slot sorts by (gap, stayer / moved in / waiting, order within).
+    struct Slot { std::size_t gap; int kind; long order; std::size_t k; };
+    std::vector<Slot> slots;
+    std::size_t gap = 0;
+    for (std::size_t k = 0; k < kept.size(); ++k)
+    {
+      if (stays[k])
+        slots.push_back({++gap, 0, 0, k});
+      else
+      {
+        auto waits = std::lower_bound(stayers.begin(), stayers.end(), kept[k]) - stayers.begin();
+        slots.push_back({gap, 1, long(k), k});
+        slots.push_back({std::size_t(waits), 2, kept[k], k});
+      }
+    }
+    std::sort(slots.begin(), slots.end(), [](const Slot &x, const Slot &y) {
+      return std::tie(x.gap, x.kind, x.order) < std::tie(y.gap, y.kind, y.order);
+    });
+
+    std::vector<std::size_t> waits(kept.size()), moved(kept.size());
+    std::vector<long> tree(slots.size() + 1, 0);
+    auto add = [&](std::size_t i, long d) {
+      for (++i; i < tree.size(); i += i & -i)
+        tree[i] += d;
+    };
+    auto before = [&](std::size_t i) {
+      long n = 0;
+      for (; i; i -= i & -i)
+        n += tree[i];
+      return std::size_t(n);
+    };
+
+    for (std::size_t i = 0; i < slots.size(); ++i)
+    {
+      (slots[i].kind == 1 ? moved : waits)[slots[i].k] = i;
+      if (slots[i].kind != 1)
+        add(i, 1);
+    }
+
+    for (std::size_t k = 0; k < kept.size(); ++k)
+    {
+      if (stays[k])
+        continue;
+
+      auto at = before(waits[k]);
+      add(waits[k], -1);
+      auto to = before(moved[k]);
+      add(moved[k], 1);
+
+      if (at != to)
+        patch.push_back({Edit::move, path, lo + at, lo + to, std::nullopt});
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Marks a longest increasing subsequence of v, in O(n log n): tail[l] is
+  // the index of the smallest last element of an increasing run of length
+  // l + 1, and back[] links each element to the one before it in its run.
+  static std::vector<bool> increasing(const std::vector<long> &v)
+  {
+    std::vector<std::size_t> tail, back(v.size());
+    for (std::size_t i = 0; i < v.size(); ++i)
+    {
+      auto l = std::partition_point(tail.begin(), tail.end(),
+        [&](std::size_t t) { return v[t] < v[i]; }) - tail.begin();
+      back[i] = l ? tail[l - 1] : i;
+      if (std::size_t(l) == tail.size())
+        tail.push_back(i);
+      else
+        tail[l] = i;
+    }
+
+    std::vector<bool> in(v.size(), false);
+    if (!tail.empty())
+      for (auto i = tail.back(); ; i = back[i])
+      {
+        in[i] = true;
+        if (back[i] == i)
+          break;
+      }
+    return in;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Matches the unmatched new shapes in [lo, nb) with unused old ones in
+  // [lo, na) that are the same. 'key' gives the hash bucket of a shape, or
+  // false to leave it out.
+  template<typename K>
+  void match(const Drawing &a, const Drawing &b, std::size_t lo, std::size_t na,
+    std::size_t nb, std::vector<long> &from, std::vector<bool> &used, K key)
+  {
+    std::unordered_multimap<std::size_t, std::size_t> old;
+    std::size_t k;
+    for (auto i = lo; i < na; ++i)
+      if (!used[i] && key(a[i], k))
+        old.emplace(k, i);
+
+    for (auto j = lo; j < nb && !old.empty(); ++j)
+    {
+      if (from[j - lo] >= 0 || !key(b[j], k))
+        continue;
+
+      auto [first, last] = old.equal_range(k);
+      for (auto it = first; it != last; ++it)
+        if (same(a[it->second], b[j]))
+        {
+          from[j - lo] = it->second;
+          used[it->second] = true;
+          old.erase(it);
+          break;
+        }
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  static bool is_drawing(const Shape &s) { return std::holds_alternative<Drawing>(s); }
+
+  bool same(const Shape &x, const Shape &y)
+  {
+    if (x.index() != y.index())
+      return false;
+
+    if (auto dx = std::get_if<Drawing>(&x))
+    {
+      auto &dy = std::get<Drawing>(y);
+      return dx->id() == dy.id() || (hash(x) == hash(y) && equal(*dx, dy));
+    }
+
+    return std::visit([&](auto &s) {
+      using T = std::decay_t<decltype(s)>;
+      if constexpr (std::is_same_v<T, Drawing>)
+        return false;
+      else
+        return s == std::get<T>(y);
+    }, x);
+  }
+
+  static bool equal(const Drawing &a, const Drawing &b)
+  {
+    if (a.id() == b.id())
+      return true;
+    if (a.size() != b.size())
+      return false;
+
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+      if (a[i].index() != b[i].index())
+        return false;
+      if (auto d = std::get_if<Drawing>(&a[i]))
+      {
+        if (!equal(*d, std::get<Drawing>(b[i])))
+          return false;
+      }
+      else if (!std::visit([&](auto &s) {
+          using T = std::decay_t<decltype(s)>;
+          if constexpr (std::is_same_v<T, Drawing>)
+            return false;
+          else
+            return s == std::get<T>(b[i]);
+        }, a[i]))
+        return false;
+    }
+    return true;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::size_t hash(const Shape &s)
+  {
+    auto mix = [](std::size_t h, std::size_t v) {
+      return h ^ (v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2));
+    };
+
+    if (auto d = std::get_if<Drawing>(&s))
+    {
+      auto it = m_hash.find(d->id());
+      if (it != m_hash.end())
+        return it->second;
+
+      std::size_t h = 3;
+      for (std::size_t i = 0; i < d->size(); ++i)
+        h = mix(h, hash((*d)[i]));
+      ++m_hashed;
+      return m_hash[d->id()] = h;
+    }
+
+    ++m_hashed;
+    std::size_t h = s.index();
+    std::visit([&](auto &leaf) {
+      using T = std::decay_t<decltype(leaf)>;
+      if constexpr (!std::is_same_v<T, Drawing>)
+      {
+        auto [x, y] = leaf.getPosition();
+        h = mix(mix(h, x), y);
+        if constexpr (std::is_same_v<T, Rectangle>)
+        {
+          auto [w, hh] = leaf.getSize();
+          h = mix(mix(h, w), hh);
+        }
+        else
+          h = mix(h, leaf.getSize());
+      }
+    }, s);
+    return h;
+  }
+
+  std::unordered_map<const void *, std::size_t> m_hash;
+  std::size_t m_hashed = 0;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A copy that shares nothing with the original.
+Drawing deep_copy(const Drawing &d)
+{
+  Drawing c;
+  for (std::size_t i = 0; i < d.size(); ++i)
+    if (auto sub = std::get_if<Drawing>(&d[i]))
+      c.insert(i, deep_copy(*sub));
+    else
+      c.insert(i, d[i]);
+  return c;
+}
+
+std::size_t json_size(const Drawing &d)
+{
+  std::ostringstream os;
+  ToJSON json(os);
+  json(d);
+  return os.str().size();
+}
+
+template<typename F>
+double micro(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main()
+{
+  // 100 sub-drawings of 100 sub-drawings of 100 shapes each.
+  Drawing a;
+  for (std::size_t i = 0; i < 100; ++i)
+  {
+    a.emplace_back<Drawing>();
+    for (std::size_t k = 0; k < 100; ++k)
+      a.update({i}, [&](Drawing &sub) {
+        Drawing leaf;
+        for (int j = 0; j < 100; ++j)
+          leaf.emplace_back<Rectangle>(int(i * 100 + k), j, 25, 50);
+        sub.emplace_back<Drawing>(leaf);
+      });
+  }
+
+  // A few small edits to a copy.
+  Drawing b = a;
+  b.update({3, 7}, [](Drawing &d) { d.set(5, Circle(1, 2, 3)); });
+  b.update({10}, [](Drawing &d) { d.insert(0, Triangle(4, 5, 6)); });
+  b.erase(50);
+  b.move(0, 20);
+  b.update({60, 1}, Scale(2));
+  b.update({70, 70}, [](Drawing &d) { d.move(99, 0); d.erase(50); });
+
+  Diff diff;
+  Patch patch;
+  auto shared_us = micro([&] { patch = diff(a, b); });
+
+  std::ostringstream os;
+  write(os, patch);
+
+  Drawing c = deep_copy(a);
+  apply_patch(c, patch);
+
+  std::cout << "patch: " << patch.size() << " edits, " << os.str().size()
+            << " bytes; ToJSON of the drawing: " << json_size(b) << " bytes\n"
+            << "diff of versions sharing nodes: " << shared_us << " us, "
+            << diff.hashed() << " shapes hashed\n"
+            << "patched copy equals the edited drawing: " << std::boolalpha
+            << diff(c, b).empty() << '\n';
+
+  // The same drawings, sharing nothing: every sub-drawing has to be hashed.
+  auto a2 = deep_copy(a), b2 = deep_copy(b);
+  Diff deep;
+  Patch patch2;
+  auto deep_us = micro([&] { patch2 = deep(a2, b2); });
+
+  std::ostringstream os2;
+  write(os2, patch2);
+
+  std::cout << "diff of unshared drawings: " << deep_us << " us, "
+            << deep.hashed() << " shapes hashed, same patch: "
+            << (os.str() == os2.str()) << '\n';
+
+  return 0;
+}
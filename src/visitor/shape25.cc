@@ -0,0 +1,422 @@
+/*
+clang++ -std=c++20 -O2 shape25.cc \
+*/
+
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+inline std::size_t mix(std::size_t h, std::size_t v)
+{
+  return h ^ (v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2));
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The hash of a leaf, from its position and size.
+template<typename T>
+std::size_t hash_leaf(const T &s)
+{
+  std::size_t h = 0;
+  auto add = [&](auto... v) { ((h = mix(h, v)), ...); };
+
+  std::apply(add, s.getPosition());
+  auto size = s.getSize();
+  if constexpr (requires { std::tuple_size<decltype(size)>::value; })
+    std::apply(add, size);
+  else
+    add(size);
+  return h;
+}
+
+
+//=========================================================
+// The persistent Composite of shape18.cc, where each node also keeps the
+// hash of its content: the hashes of its shapes, in order. A sub-drawing
+// keeps its own, so a node is hashed from its direct children only, and a
+// change to one shape only rehashes the nodes on the path to it.
+//
+// Nodes are never changed once they are shared, so the hash is computed
+// when the node is changed rather than when it is asked for.
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  Composite() : m_node(std::make_shared<Node>()) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Appending folds one more hash into the node's.
+  template<typename T, typename... A>
+  void emplace_back(A&&... a)
+  {
+    auto &n = node();
+    n.shapes.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    n.hash = mix(n.hash, hash_of(n.shapes.back()));
+  }
+
+  void insert(std::size_t i, value_type v)
+  {
+    node().shapes.insert(node().shapes.begin() + i, std::move(v));
+    rehash();
+  }
+
+  void set(std::size_t i, value_type v) { node().shapes[i] = std::move(v); rehash(); }
+  void erase(std::size_t i) { node().shapes.erase(node().shapes.begin() + i); rehash(); }
+
+  const value_type &operator[](std::size_t i) const { return shared().shapes[i]; }
+  std::size_t size() const { return shared().shapes.size(); }
+  const void *id() const { return m_node.get(); }
+  std::size_t hash() const { return shared().hash; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Drawings that share a node are equal, and drawings with different
+  // hashes are not; only when the hashes agree are the shapes compared,
+  // and then shared sub-drawings again cost nothing.
+  bool operator==(const Composite &other) const
+  {
+    return id() == other.id() ||
+      (hash() == other.hash() && shared().shapes == other.shared().shapes);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Calls f with the sub-drawing at 'path', copying the nodes on the way,
+  // and then rehashes them from the bottom up.
+  template<typename P, typename F>
+  void update(const P &path, F f)
+  {
+    std::vector<Composite *> up{this};
+    for (auto i : path)
+      up.push_back(&std::get<Composite>(up.back()->node().shapes[i]));
+
+    f(*up.back());
+    for (auto c = up.rbegin(); c != up.rend(); ++c)
+      (*c)->rehash();
+  }
+
+  template<typename F>
+  void update(std::initializer_list<std::size_t> path, F f)
+  {
+    update<std::initializer_list<std::size_t>>(path, f);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The visitor may change any shape, so the node is rehashed afterwards.
+  // Sub-drawings rehash themselves in their own accept().
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : node().shapes)
+    {
+      std::visit(visitor, s);
+    }
+    rehash();
+  }
+
+  template <typename T>
+  void accept(T &visitor) const
+  {
+    for (auto &s : shared().shapes)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  static constexpr std::size_t seed = 3;
+
+  struct Node {
+    std::vector<value_type> shapes;
+    std::size_t hash = seed;
+  };
+
+  // The node, possibly shared with other copies: read only.
+  const Node &shared() const { return *m_node; }
+
+  // The node, made private to this copy first.
+  Node &node()
+  {
+    if (m_node.use_count() > 1)
+      m_node = std::make_shared<Node>(*m_node);
+    return *m_node;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  static std::size_t hash_of(const value_type &s)
+  {
+    return mix(s.index(), std::visit([](auto &v) {
+      if constexpr (std::is_same_v<std::decay_t<decltype(v)>, Composite>)
+        return v.hash();
+      else
+        return hash_leaf(v);
+    }, s));
+  }
+
+  void rehash()
+  {
+    auto &n = node();
+    n.hash = seed;
+    for (auto &s : n.shapes)
+      n.hash = mix(n.hash, hash_of(s));
+  }
+
+  std::shared_ptr<Node> m_node;
+};
+
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+  void setSize(int radius) { m_radius = radius; }
+
+  bool operator==(const Circle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+  void setSize(int len) { m_len = len; }
+
+  bool operator==(const Triangle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+  void setSize(int w, int h) { m_w = w; m_h = h; }
+
+  bool operator==(const Rectangle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+using Shape = Drawing::value_type;
+
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setSize(s.getSize() * m_ratio); }
+  void operator()(Triangle &s) { s.setSize(s.getSize() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    s.setSize(w * m_ratio, h * m_ratio);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+
+//=========================================================
+// Hashes a drawing from scratch, the way it had to be done without the
+// cached hashes. Gives the same value as Drawing::hash().
+class FullHash {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T>
+  void operator()(const T &s) { m_hash = hash_leaf(s); }
+
+  void operator()(const Drawing &d)
+  {
+    std::size_t h = 3;
+    for (std::size_t i = 0; i < d.size(); ++i)
+    {
+      std::visit(*this, d[i]);
+      h = mix(h, mix(d[i].index(), m_hash));
+    }
+    m_hash = h;
+  }
+
+  std::size_t hash() const { return m_hash; }
+
+//---------------------------------------------------------
+private:
+  std::size_t m_hash = 0;
+};
+
+std::size_t full_hash(const Drawing &d)
+{
+  FullHash f;
+  f(d);
+  return f.hash();
+}
+
+
+//=========================================================
+// Makes equal sub-drawings share one node. Each sub-drawing is looked up
+// by its hash after its own sub-drawings have been merged, so equal
+// subtrees end up with the same id() and compare in O(1).
+class Dedup {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Drawing operator()(const Drawing &d)
+  {
+    Drawing out = d;
+    for (std::size_t i = 0; i < d.size(); ++i)
+      if (auto sub = std::get_if<Drawing>(&d[i]))
+      {
+        auto c = (*this)(*sub);
+        if (c.id() != sub->id())
+          out.set(i, c);
+      }
+
+    auto &bucket = m_seen[out.hash()];
+    for (auto &s : bucket)
+      if (s == out)
+        return s;
+    bucket.push_back(out);
+    return out;
+  }
+
+//---------------------------------------------------------
+private:
+  std::unordered_map<std::size_t, std::vector<Drawing>> m_seen;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The number of distinct nodes in a drawing.
+std::size_t nodes(const Drawing &d, std::unordered_set<const void *> &seen)
+{
+  if (!seen.insert(d.id()).second)
+    return 0;
+
+  std::size_t n = 1;
+  for (std::size_t i = 0; i < d.size(); ++i)
+    if (auto sub = std::get_if<Drawing>(&d[i]))
+      n += nodes(*sub, seen);
+  return n;
+}
+
+std::size_t nodes(const Drawing &d)
+{
+  std::unordered_set<const void *> seen;
+  return nodes(d, seen);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// A copy that shares nothing with the original.
+Drawing deep_copy(const Drawing &d)
+{
+  Drawing c;
+  for (std::size_t i = 0; i < d.size(); ++i)
+    if (auto sub = std::get_if<Drawing>(&d[i]))
+      c.insert(i, deep_copy(*sub));
+    else
+      c.insert(i, d[i]);
+  return c;
+}
+
+template<typename F>
+double micro(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main()
+{
+  // 100 sub-drawings of 100 sub-drawings of 100 shapes each. There are
+  // only 10 different sub-drawings at the bottom, built separately.
+  Drawing a;
+  for (std::size_t i = 0; i < 100; ++i)
+  {
+    a.emplace_back<Drawing>();
+    for (std::size_t k = 0; k < 100; ++k)
+      a.update({i}, [&](Drawing &sub) {
+        Drawing leaf;
+        for (int j = 0; j < 100; ++j)
+          leaf.emplace_back<Rectangle>(int(k % 10), j, 25, 50);
+        sub.emplace_back<Drawing>(leaf);
+      });
+  }
+
+  std::size_t cached = 0, full = 0;
+  auto cached_us = micro([&] { cached = a.hash(); });
+  auto full_us = micro([&] { full = full_hash(a); });
+  std::cout << "hash: cached " << cached_us << " us, full traversal " << full_us
+            << " us, same: " << std::boolalpha << (cached == full) << '\n';
+
+  // Changing a shape rehashes the three nodes above it.
+  Drawing b = a;
+  auto update_us = micro([&] {
+    b.update({3, 7}, [](Drawing &d) { d.set(5, Circle(1, 2, 3)); });
+  });
+  b.update({60, 1}, Scale(2));
+  std::cout << "update: " << update_us << " us, hash still right: "
+            << (b.hash() == full_hash(b)) << '\n';
+
+  // Different hashes are decided at once; equal ones in a copy that shares
+  // nothing have to be compared shape by shape.
+  auto c = deep_copy(a);
+  bool ne = true, eq = false;
+  auto ne_us = micro([&] { ne = (a == b); });
+  auto eq_us = micro([&] { eq = (a == c); });
+  std::cout << "a == b: " << ne << ", " << ne_us << " us\n"
+            << "a == deep copy: " << eq << ", " << eq_us << " us\n";
+
+  // After merging equal sub-drawings, equal drawings share their nodes.
+  Dedup dedup;
+  auto da = dedup(a);
+  auto dc = dedup(c);
+  auto shared_us = micro([&] { eq = (da == dc); });
+  std::cout << "nodes: " << nodes(a) << " before dedup, " << nodes(da) << " after\n"
+            << "deduped a == deduped copy: " << eq << ", " << shared_us << " us\n";
+
+  return 0;
+}
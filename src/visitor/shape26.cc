@@ -0,0 +1,607 @@
+/*
+clang++ -std=c++20 -O2 shape26.cc \
+*/
+
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <new>
+#include <optional>
+#include <system_error>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  std::size_t size() const { return m_shape.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor) const
+  {
+    for (auto &s : m_shape)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() const { return m_shape.begin(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+// A shape in shared memory. A drawing refers to its shapes by position
+// in the same array rather than by address, so the array means the same
+// thing wherever it is mapped.
+struct Record {
+  enum Kind : std::uint32_t { circle, triangle, rectangle, drawing };
+
+  Kind kind;
+  std::int32_t v[4];   // x, y and size; for a drawing the first shape and count
+};
+
+//=========================================================
+// A read-only view of a drawing in shared memory. accept() hands each
+// shape to the visitor as it is read; nothing is copied up front.
+//
+// A reader may see a buffer while it is being overwritten (see
+// Subscriber::read()), so the view never trusts what it reads: positions
+// are kept inside the buffer and a drawing's shapes always come after it,
+// which makes any traversal end.
+class SharedDrawing {
+public:
+
+  SharedDrawing(const Record *records, std::size_t capacity, std::size_t at)
+    : m_records(records), m_capacity(capacity), m_at(at) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor) const
+  {
+    std::size_t first = std::uint32_t(m_records[m_at].v[0]);
+    std::size_t count = std::uint32_t(m_records[m_at].v[1]);
+    if (first <= m_at)
+      return;
+
+    auto last = std::min(first + count, m_capacity);
+    for (auto i = first; i < last; ++i)
+    {
+      auto &r = m_records[i];
+      switch (r.kind)
+      {
+        case Record::circle: visitor(Circle(r.v[0], r.v[1], r.v[2])); break;
+        case Record::triangle: visitor(Triangle(r.v[0], r.v[1], r.v[2])); break;
+        case Record::rectangle: visitor(Rectangle(r.v[0], r.v[1], r.v[2], r.v[3])); break;
+        case Record::drawing: visitor(SharedDrawing(m_records, m_capacity, i)); break;
+      }
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  const Record *m_records;
+  std::size_t m_capacity, m_at;
+};
+
+
+
+//=========================================================
+// The layout of the shared memory: a header, then two buffers of
+// 'capacity' records each. Version v of the drawing is in buffer v % 2,
+// so the writer fills the buffer readers are not being sent to.
+//
+// Each buffer also has a sequence number, odd while it is being written.
+// A reader that finds it changed after reading has seen a mix of two
+// versions and starts again. The buffer records which version it holds:
+// by the time a reader gets to it, the writer may have moved on by two.
+struct Header {
+  std::atomic<std::uint64_t> version;
+  std::uint64_t capacity;
+};
+
+struct Buffer {
+  std::atomic<std::uint64_t> seq;
+  std::uint64_t version;
+  std::int64_t stamp;   // steady_clock time of publishing, in ns
+};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+std::size_t buffer_bytes(std::size_t capacity)
+{
+  return (sizeof(Buffer) + capacity * sizeof(Record) + 63) / 64 * 64;
+}
+
+std::size_t region_bytes(std::size_t capacity)
+{
+  return 64 + 2 * buffer_bytes(capacity);
+}
+
+[[noreturn]] void fail(const std::string &what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+std::int64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//=========================================================
+// Owns the shared memory and writes drawings into it.
+class Publisher {
+public:
+
+  Publisher(const std::string &name, std::size_t capacity)
+    : m_name(name), m_bytes(region_bytes(capacity))
+  {
+    auto fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      fail("shm_open " + name);
+
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, m_bytes) == 0)
+      base = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      auto error = errno;
+      close(fd);
+      shm_unlink(name.c_str());
+      errno = error;
+      fail("mapping " + name);
+    }
+    close(fd);
+
+    m_base = static_cast<char *>(base);
+    m_header = new (m_base) Header{{0}, capacity};
+    for (int i = 0; i < 2; ++i)
+      new (buffer(i)) Buffer{{0}, 0, 0};
+  }
+
+  ~Publisher()
+  {
+    munmap(m_base, m_bytes);
+    shm_unlink(m_name.c_str());
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Writes 'd' as the next version. Returns false, and leaves the
+  // current version in place, if it does not fit.
+  bool publish(const Drawing &d)
+  {
+    if (1 + needed(d) > m_header->capacity)
+      return false;
+
+    auto v = m_header->version.load(std::memory_order_relaxed) + 1;
+    auto b = buffer(v % 2);
+    auto seq = b->seq.load(std::memory_order_relaxed);
+
+    b->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::size_t end = 1;
+    write(d, records(b), 0, end);
+    b->version = v;
+    b->stamp = now_ns();
+
+    b->seq.store(seq + 2, std::memory_order_release);
+    m_header->version.store(v, std::memory_order_release);
+    return true;
+  }
+
+//---------------------------------------------------------
+private:
+  Buffer *buffer(int i) { return reinterpret_cast<Buffer *>(m_base + 64 + i * buffer_bytes(m_header->capacity)); }
+  static Record *records(Buffer *b) { return reinterpret_cast<Record *>(b + 1); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  static std::size_t needed(const Drawing &d)
+  {
+    std::size_t n = d.size();
+    for (auto &s : d)
+      if (auto sub = std::get_if<Drawing>(&s))
+        n += needed(*sub);
+    return n;
+  }
+
+  // Writes the drawing record at 'at', and its shapes from 'end' on.
+  static void write(const Drawing &d, Record *out, std::size_t at, std::size_t &end)
+  {
+    auto first = end;
+    end += d.size();
+    out[at] = {Record::drawing, {std::int32_t(first), std::int32_t(d.size())}};
+
+    auto i = first;
+    for (auto &s : d)
+    {
+      std::visit([&](auto &shape) {
+        using T = std::decay_t<decltype(shape)>;
+        if constexpr (std::is_same_v<T, Drawing>)
+          write(shape, out, i, end);
+        else
+        {
+          auto [x, y] = shape.getPosition();
+          if constexpr (std::is_same_v<T, Rectangle>)
+          {
+            auto [w, h] = shape.getSize();
+            out[i] = {Record::rectangle, {x, y, w, h}};
+          }
+          else
+            out[i] = {std::is_same_v<T, Circle> ? Record::circle : Record::triangle,
+                      {x, y, shape.getSize()}};
+        }
+      }, s);
+      ++i;
+    }
+  }
+
+  std::string m_name;
+  std::size_t m_bytes;
+  char *m_base;
+  Header *m_header;
+};
+
+
+//=========================================================
+// Maps the shared memory read-only in another process.
+class Subscriber {
+public:
+
+  struct Snapshot {
+    std::uint64_t version;
+    std::int64_t stamp;
+  };
+
+  Subscriber(const std::string &name)
+  {
+    auto fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      fail("shm_open " + name);
+
+    void *base = MAP_FAILED;
+    auto n = pread(fd, &m_capacity, sizeof(std::uint64_t), offsetof(Header, capacity));
+    if (n == sizeof(std::uint64_t))
+    {
+      m_bytes = region_bytes(m_capacity);
+      base = mmap(nullptr, m_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    else if (n >= 0)
+      errno = EINVAL;   // too short to hold a header
+
+    auto error = errno;
+    close(fd);
+    errno = error;
+    if (base == MAP_FAILED)
+      fail("mapping " + name);
+
+    m_base = static_cast<const char *>(base);
+    m_header = reinterpret_cast<const Header *>(m_base);
+  }
+
+  ~Subscriber() { munmap(const_cast<char *>(m_base), m_bytes); }
+
+  std::uint64_t version() const { return m_header->version.load(std::memory_order_acquire); }
+  std::size_t retries() const { return m_retries; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Calls f with the latest version, in place. If the writer overwrote
+  // the buffer in the meantime f is called again, so f should start from
+  // scratch each time. Returns version 0 if nothing was published yet.
+  template<typename F>
+  Snapshot read(F f)
+  {
+    for (;;)
+    {
+      auto v = version();
+      if (v == 0)
+        return {0, 0};
+
+      auto b = reinterpret_cast<const Buffer *>(m_base + 64 + (v % 2) * buffer_bytes(m_capacity));
+      auto seq = b->seq.load(std::memory_order_acquire);
+      if (seq % 2 == 0)
+      {
+        Snapshot snap{b->version, b->stamp};
+        f(SharedDrawing(reinterpret_cast<const Record *>(b + 1), m_capacity, 0));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (b->seq.load(std::memory_order_relaxed) == seq)
+          return snap;
+      }
+      ++m_retries;
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  const char *m_base;
+  const Header *m_header;
+  std::size_t m_capacity, m_bytes;
+  std::size_t m_retries = 0;
+};
+
+
+
+//=========================================================
+// A read-only visitor; it works the same on a Drawing and on a
+// SharedDrawing.
+class Count {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s) { add(s); }
+  void operator()(const Triangle &s) { add(s); }
+  void operator()(const Rectangle &s) { add(s); }
+
+  template<typename D>
+  void operator()(const D &d) { d.accept(*this); }
+
+  std::size_t shapes() const { return m_shapes; }
+  long long sum() const { return m_sum; }
+
+//---------------------------------------------------------
+private:
+  template<typename T>
+  void add(const T &s)
+  {
+    auto [x, y] = s.getPosition();
+    ++m_shapes;
+    m_sum += x + y;
+  }
+
+  std::size_t m_shapes = 0;
+  long long m_sum = 0;
+};
+
+
+//=========================================================
+// What the processes used to send each other.
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    m_os << "{\"circle\": {\"x\": " << x << ", \"y\": " << y
+         << ", \"radius\": " << s.getSize() << "}}";
+  }
+
+  void operator()(const Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    m_os << "{\"triangle\": {\"x\": " << x << ", \"y\": " << y
+         << ", \"len\": " << s.getSize() << "}}";
+  }
+
+  void operator()(const Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+    m_os << "{\"rectangle\": {\"x\": " << x << ", \"y\": " << y
+         << ", \"w\": " << w << ", \"h\": " << h << "}}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Drawing &d)
+  {
+    m_os << "{\"drawing\": [";
+    for (auto it = d.begin(); it != d.end(); ++it)
+    {
+      if (it != d.begin())
+        m_os << ", ";
+      std::visit(*this, *it);
+    }
+    m_os << "]}";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Version v of the drawing: 100 sub-drawings of 100 + v % 8 shapes.
+Drawing make(int v)
+{
+  Drawing d;
+  for (int i = 0; i < 100; ++i)
+  {
+    auto &sub = d.add<Drawing>();
+    for (int j = 0; j < 100 + v % 8; ++j)
+      switch (j % 3)
+      {
+        case 0: sub.add<Circle>(i, j + v, 5); break;
+        case 1: sub.add<Triangle>(i, j + v, 7); break;
+        case 2: sub.add<Rectangle>(i, j + v, 3, 4); break;
+      }
+  }
+  return d;
+}
+
+Count count(const Drawing &d)
+{
+  Count c;
+  c(d);
+  return c;
+}
+
+
+//=========================================================
+int main()
+{
+  const std::string name = "/shape26-" + std::to_string(getpid());
+  const int versions = 2000;
+
+  std::vector<Drawing> drawings;
+  for (int v = 0; v < 8; ++v)
+    drawings.push_back(make(v));
+
+  std::optional<Publisher> pub;
+  try
+  {
+    pub.emplace(name, 1 << 20);
+  }
+  catch (const std::system_error &e)
+  {
+    std::cerr << "writer: " << e.what() << '\n';
+    return 1;
+  }
+
+  auto pid = fork();
+  if (pid == 0)
+  {
+    // The reader: traverses each version it sees in place, and checks it
+    // against what the writer built.
+    std::optional<Subscriber> opened;
+    try
+    {
+      opened.emplace(name);
+    }
+    catch (const std::system_error &e)
+    {
+      std::cerr << "reader: " << e.what() << std::endl;
+      _exit(2);
+    }
+
+    auto &sub = *opened;
+    std::uint64_t last = 0;
+    int seen = 0, wrong = 0;
+    std::vector<double> latency;
+
+    while (last < versions)
+    {
+      if (sub.version() == last)
+      {
+        sched_yield();
+        continue;
+      }
+
+      Count c;
+      auto snap = sub.read([&](const SharedDrawing &d) { c = Count(); c(d); });
+      latency.push_back((now_ns() - snap.stamp) / 1000.0);
+
+      auto expected = count(drawings[snap.version % 8]);
+      if (c.shapes() != expected.shapes() || c.sum() != expected.sum())
+        ++wrong;
+      ++seen;
+      last = snap.version;
+    }
+
+    std::sort(latency.begin(), latency.end());
+    std::cout << "reader: saw " << seen << " of " << versions << " versions, "
+              << wrong << " wrong, " << sub.retries() << " retries, median "
+              << latency[latency.size() / 2] << " us from publish to traversed" << std::endl;
+    _exit(wrong ? 1 : 0);
+  }
+
+  // The writer.
+  std::vector<double> publish;
+  for (int v = 1; v <= versions; ++v)
+  {
+    auto t0 = now_ns();
+    pub->publish(drawings[v % 8]);
+    publish.push_back((now_ns() - t0) / 1000.0);
+    usleep(200);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+
+  auto t0 = now_ns();
+  std::ostringstream os;
+  ToJSON json(os);
+  json(drawings[0]);
+  double json_us = (now_ns() - t0) / 1000.0;
+
+  std::sort(publish.begin(), publish.end());
+  std::cout << "writer: median publish " << publish[publish.size() / 2] << " us for "
+            << count(drawings[0]).shapes() << " shapes; ToJSON took " << json_us
+            << " us for " << os.str().size() << " bytes\n"
+            << "reader exit status: " << WEXITSTATUS(status) << '\n';
+
+  return 0;
+}
@@ -0,0 +1,354 @@
+/*
+clang++ -std=c++20 -O2 shape27.cc \
+*/
+
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <string>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() const { return m_shape.begin(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+//=========================================================
+// The blocking serializer.
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Drawing &d)
+  {
+    m_os << "\"drawing\": [\n";
+    for (auto it = d.begin(); it != d.end(); ++it)
+    {
+      if (it != d.begin())
+        m_os << ",\n";
+      std::visit(*this, *it);
+    }
+    m_os << "]\n";
+  }
+
+//---------------------------------------------------------
+private:
+  std::ostream &m_os;
+};
+
+
+
+//=========================================================
+// A coroutine that does nothing until it is awaited. Awaiting it runs it,
+// and when it finishes it resumes the coroutine that awaited it, so a
+// recursion of Tasks runs without growing the stack.
+class Task {
+public:
+
+  struct promise_type {
+    std::coroutine_handle<> m_continuation = std::noop_coroutine();
+
+    Task get_return_object() { return Task(handle::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto final_suspend() noexcept
+    {
+      struct Resume {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(handle h) noexcept { return h.promise().m_continuation; }
+        void await_resume() noexcept {}
+      };
+      return Resume{};
+    }
+
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  using handle = std::coroutine_handle<promise_type>;
+
+  Task(Task &&t) : m_handle(std::exchange(t.m_handle, nullptr)) {}
+  ~Task() { if (m_handle) m_handle.destroy(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool await_ready() { return false; }
+
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting)
+  {
+    m_handle.promise().m_continuation = awaiting;
+    return m_handle;
+  }
+
+  void await_resume() {}
+
+  handle get() const { return m_handle; }
+
+//---------------------------------------------------------
+private:
+  explicit Task(handle h) : m_handle(h) {}
+
+  handle m_handle;
+};
+
+
+//=========================================================
+// Serializes a drawing a piece at a time. Each step() runs until it has
+// written 'bytes' or used up 'time', and returns what it wrote; the
+// pieces put together are exactly what ToJSON writes.
+//
+// The walk is a recursion of coroutines, one per sub-drawing. When the
+// budget runs out the innermost one suspends and step() returns; the next
+// step() resumes it where it was.
+class Exporter {
+public:
+
+  Exporter(const Drawing &d) : m_json(m_os), m_task(write(d)), m_resume(m_task.get()) {}
+
+  // The coroutine frame and m_json refer to this object and its stream,
+  // so it stays where it was made.
+  Exporter(const Exporter &) = delete;
+  Exporter &operator=(const Exporter &) = delete;
+  Exporter(Exporter &&) = delete;
+  Exporter &operator=(Exporter &&) = delete;
+
+  bool done() const { return !m_resume; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Returns an empty string once done().
+  std::string step(std::chrono::microseconds time, std::size_t bytes = -1)
+  {
+    if (done())
+      return {};
+
+    m_deadline = std::chrono::steady_clock::now() + time;
+    m_bytes = bytes;
+    std::exchange(m_resume, nullptr).resume();
+
+    auto out = std::move(m_os).str();
+    m_os.str({});
+    return out;
+  }
+
+//---------------------------------------------------------
+private:
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Suspends the coroutine that awaits it if the budget is used up. The
+  // clock is only read every few shapes.
+  struct Budget {
+    Exporter &e;
+
+    bool await_ready()
+    {
+      if (std::size_t(e.m_os.tellp()) >= e.m_bytes)
+        return false;
+      if (++e.m_shapes % 64)
+        return true;
+      return std::chrono::steady_clock::now() < e.m_deadline;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) { e.m_resume = h; }
+    void await_resume() {}
+  };
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  Task write(const Drawing &d)
+  {
+    m_os << "\"drawing\": [\n";
+    for (auto it = d.begin(); it != d.end(); ++it)
+    {
+      if (it != d.begin())
+        m_os << ",\n";
+
+      if (auto sub = std::get_if<Drawing>(&*it))
+        co_await write(*sub);
+      else
+      {
+        std::visit(m_json, *it);
+        co_await Budget{*this};
+      }
+    }
+    m_os << "]\n";
+  }
+
+  std::ostringstream m_os;
+  ToJSON m_json;
+  Task m_task;
+  std::coroutine_handle<> m_resume;
+
+  std::chrono::steady_clock::time_point m_deadline;
+  std::size_t m_bytes = -1, m_shapes = 0;
+};
+
+
+
+//=========================================================
+int main()
+{
+  using namespace std::chrono;
+
+  // 1000 sub-drawings of 1000 shapes, some nested one level further.
+  Drawing d;
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto &sub = d.add<Drawing>();
+    for (int j = 0; j < 1000; ++j)
+      switch (j % 4)
+      {
+        case 0: sub.add<Circle>(i, j, 5); break;
+        case 1: sub.add<Triangle>(i, j, 7); break;
+        case 2: sub.add<Rectangle>(i, j, 3, 4); break;
+        case 3: sub.add<Drawing>().add<Circle>(j, i, 1); break;
+      }
+  }
+
+  auto t0 = steady_clock::now();
+  std::ostringstream os;
+  ToJSON json(os);
+  json(d);
+  auto blocking = duration<double, std::milli>(steady_clock::now() - t0).count();
+
+  std::cout << "blocking ToJSON: " << os.str().size() << " bytes in "
+            << blocking << " ms\n";
+
+  // As a render loop would: 2 ms of export work per frame.
+  std::string out;
+  Exporter e(d);
+  int frames = 0;
+  double longest = 0;
+  while (!e.done())
+  {
+    auto t = steady_clock::now();
+    auto chunk = e.step(milliseconds(2));
+    longest = std::max(longest, duration<double, std::milli>(steady_clock::now() - t).count());
+    out += chunk;
+    ++frames;
+  }
+
+  std::cout << "2 ms steps: " << frames << " frames, longest step " << longest
+            << " ms, same output: " << std::boolalpha << (out == os.str()) << '\n';
+
+  // Or in chunks of about 64 KiB, e.g. to write to a socket.
+  out.clear();
+  Exporter chunks(d);
+  int n = 0;
+  while (!chunks.done())
+  {
+    out += chunks.step(hours(1), 64 * 1024);
+    ++n;
+  }
+
+  std::cout << "64 KiB chunks: " << n << " chunks, same output: "
+            << (out == os.str()) << '\n';
+
+  return 0;
+}
@@ -0,0 +1,480 @@
+/*
+clang++ -std=c++20 -O2 shape28.cc \
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <variant>
+#include <ranges>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+
+//=========================================================
+// Counts calls to the global operator new, to show that iterating makes
+// none.
+std::size_t allocations = 0;
+
+void *operator new(std::size_t size)
+{
+  ++allocations;
+  if (auto p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() const { return m_shape.begin(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+// A shape met on the way through a drawing, and how many sub-drawings
+// down it is.
+struct Entry {
+  std::size_t depth;
+  const Shape &shape;
+};
+
+//=========================================================
+// Goes through a drawing depth first. The position in each enclosing
+// drawing is kept in a fixed array of MaxDepth levels, so iterating never
+// allocates unless drawings are nested deeper than that; the levels below
+// MaxDepth go on the heap.
+//
+// With Nodes false it stops at the leaves only, and dereferences to the
+// shape; given a Leaf type as well, it stops only at leaves of that type
+// and dereferences to the Leaf. With Nodes true it stops at sub-drawings
+// as well, before their shapes, and dereferences to an Entry.
+template<bool Nodes, typename Leaf = void, std::size_t MaxDepth = 16>
+class FlatIterator {
+  static_assert(!Nodes || std::is_void_v<Leaf>);
+
+public:
+  using value_type = std::conditional_t<Nodes, Entry,
+    std::conditional_t<std::is_void_v<Leaf>, Shape, Leaf>>;
+  using difference_type = std::ptrdiff_t;
+
+  FlatIterator() = default;
+  explicit FlatIterator(const Drawing &d) { push(d); settle(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  decltype(auto) operator*() const
+  {
+    if constexpr (Nodes)
+      return Entry{depth(), *top().at};
+    else if constexpr (std::is_void_v<Leaf>)
+      return *top().at;
+    else
+      return *std::get_if<Leaf>(&*top().at);
+  }
+
+  std::size_t depth() const { return m_size - 1; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  FlatIterator &operator++()
+  {
+    auto d = std::get_if<Drawing>(&*top().at);
+    if (Nodes && d)
+      push(*d);
+    else
+      ++top().at;
+    settle();
+    return *this;
+  }
+
+  FlatIterator operator++(int)
+  {
+    auto tmp = *this;
+    ++*this;
+    return tmp;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool operator==(std::default_sentinel_t) const { return m_size == 0; }
+
+  bool operator==(const FlatIterator &other) const
+  {
+    return m_size == other.m_size && (m_size == 0 || top().at == other.top().at);
+  }
+
+//---------------------------------------------------------
+private:
+  using It = decltype(std::declval<const Drawing &>().begin());
+
+  struct Level {
+    It at, end;
+  };
+
+  Level &top() { return m_size > MaxDepth ? m_deeper.back() : m_stack[m_size - 1]; }
+  const Level &top() const { return m_size > MaxDepth ? m_deeper.back() : m_stack[m_size - 1]; }
+
+  void push(const Drawing &d)
+  {
+    if (m_size < MaxDepth)
+      m_stack[m_size] = {d.begin(), d.end()};
+    else
+      m_deeper.push_back({d.begin(), d.end()});
+    ++m_size;
+  }
+
+  // Returns false once the outermost drawing is done.
+  bool pop()
+  {
+    if (m_size > MaxDepth)
+      m_deeper.pop_back();
+    return --m_size;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Moves on to the next place to stop at, if this is not one: out of
+  // drawings that are done, for leaves only into sub-drawings, and past
+  // leaves that are not a Leaf.
+  void settle()
+  {
+    while (m_size)
+    {
+      // The siblings are gone through in a tight loop of their own.
+      auto &level = top();
+      const Drawing *d = nullptr;
+      for (; level.at != level.end; ++level.at)
+      {
+        d = std::get_if<Drawing>(&*level.at);
+        if (d && !Nodes)
+          break;
+        if constexpr (std::is_void_v<Leaf>)
+          return;
+        else if (std::holds_alternative<Leaf>(*level.at))
+          return;
+      }
+
+      if (level.at != level.end)
+        push(*d);
+      else if (pop())
+        ++top().at;
+    }
+  }
+
+  std::array<Level, MaxDepth> m_stack;
+  std::vector<Level> m_deeper;
+  std::size_t m_size = 0;
+};
+
+
+//=========================================================
+template<bool Nodes, typename Leaf = void>
+class FlatView : public std::ranges::view_interface<FlatView<Nodes, Leaf>> {
+public:
+
+  FlatView() = default;
+  explicit FlatView(const Drawing &d) : m_drawing(&d) {}
+
+  auto begin() const { return FlatIterator<Nodes, Leaf>(*m_drawing); }
+  auto end() const { return std::default_sentinel; }
+
+  // The leaves of type T only, as T: what of_type<T> makes of this view.
+  template<typename T>
+  FlatView<false, T> only() const requires (!Nodes)
+  {
+    FlatView<false, T> v;
+    v.m_drawing = m_drawing;
+    return v;
+  }
+
+//---------------------------------------------------------
+private:
+  template<bool, typename> friend class FlatView;
+
+  const Drawing *m_drawing = nullptr;
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Every leaf of a drawing, however deep.
+FlatView<false> flatten(const Drawing &d) { return FlatView<false>(d); }
+
+// Every shape and sub-drawing, with its depth.
+FlatView<true> walk(const Drawing &d) { return FlatView<true>(d); }
+
+//=========================================================
+// The shapes of type T in a range of shapes, as T. It does what
+// std::views::filter and std::views::transform would, but moves its
+// iterator on in place: std::views::filter copies it at every step, and a
+// FlatIterator carries its whole stack. Over flatten() the FlatIterator
+// skips the other leaves itself, as it goes, and of_type gives that.
+template<typename V, typename T>
+class OfTypeView : public std::ranges::view_interface<OfTypeView<V, T>> {
+public:
+
+  //=========================================================
+  class iterator {
+  public:
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+
+    iterator() = default;
+    iterator(std::ranges::iterator_t<V> at, std::ranges::sentinel_t<V> end)
+      : m_at(std::move(at)), m_end(std::move(end)) { skip(); }
+
+    //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+    const T &operator*() const { return std::get<T>(*m_at); }
+
+    iterator &operator++() { ++m_at; skip(); return *this; }
+
+    iterator operator++(int)
+    {
+      auto tmp = *this;
+      ++*this;
+      return tmp;
+    }
+
+    bool operator==(std::default_sentinel_t) const { return m_at == m_end; }
+    bool operator==(const iterator &other) const { return m_at == other.m_at; }
+
+  //---------------------------------------------------------
+  private:
+    void skip()
+    {
+      while (m_at != m_end && !std::holds_alternative<T>(*m_at))
+        ++m_at;
+    }
+
+    std::ranges::iterator_t<V> m_at;
+    std::ranges::sentinel_t<V> m_end;
+  };
+
+  OfTypeView() = default;
+  explicit OfTypeView(V base) : m_base(std::move(base)) {}
+
+  auto begin() const { return iterator(std::ranges::begin(m_base), std::ranges::end(m_base)); }
+  auto end() const { return std::default_sentinel; }
+
+//---------------------------------------------------------
+private:
+  V m_base;
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename T>
+struct OfType {
+  template<std::ranges::viewable_range R>
+  friend auto operator|(R &&r, OfType)
+  {
+    if constexpr (std::is_same_v<std::remove_cvref_t<R>, FlatView<false>>)
+      return r.template only<T>();
+    else
+      return OfTypeView<std::views::all_t<R>, T>(std::views::all(std::forward<R>(r)));
+  }
+};
+
+template<typename T>
+inline constexpr OfType<T> of_type;
+
+static_assert(std::ranges::forward_range<FlatView<false>>);
+static_assert(std::ranges::view<FlatView<true>>);
+static_assert(std::ranges::forward_range<OfTypeView<FlatView<false>, Circle>>);
+static_assert(std::ranges::forward_range<FlatView<false, Circle>>);
+
+
+
+//=========================================================
+// The same query as a visitor.
+class RectangleArea {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &) {}
+  void operator()(const Triangle &) {}
+
+  void operator()(const Rectangle &s)
+  {
+    auto [w, h] = s.getSize();
+    m_area += (long long)w * h;
+  }
+
+  void operator()(const Drawing &d)
+  {
+    for (auto &s : d)
+      std::visit(*this, s);
+  }
+
+  long long area() const { return m_area; }
+
+//---------------------------------------------------------
+private:
+  long long m_area = 0;
+};
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename F>
+void measure(const char *what, F f)
+{
+  auto n = allocations;
+  auto t0 = std::chrono::steady_clock::now();
+  auto result = f();
+  std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
+
+  std::cout << std::left << std::setw(24) << what << std::right
+            << std::setw(12) << result << ", "
+            << allocations - n << " allocations, "
+            << std::fixed << std::setprecision(1) << std::setw(6) << ms.count() << " ms\n";
+}
+
+
+//=========================================================
+int main()
+{
+  // A small drawing, walked with its depth.
+  Drawing small;
+  small.add<Circle>(1, 1, 1);
+  auto &sub = small.add<Drawing>();
+  sub.add<Rectangle>(2, 2, 3, 4);
+  sub.add<Drawing>().add<Triangle>(5, 5, 6);
+  small.add<Rectangle>(7, 7, 8, 9);
+
+  const char *name[] = { "circle", "triangle", "rectangle", "drawing" };
+  for (auto [depth, shape] : walk(small))
+    std::cout << std::string(2 * depth, ' ') << name[shape.index()] << '\n';
+
+  // Composes with the standard views.
+  for (auto &r : flatten(small) | of_type<Rectangle> | std::views::take(1))
+    std::cout << "first rectangle at x = " << std::get<0>(r.getPosition()) << '\n';
+
+  // Nested deeper than the fixed stack: the rest of the levels go on the heap.
+  Drawing deep;
+  auto *at = &deep;
+  for (int i = 0; i < 100; ++i)
+  {
+    at->add<Circle>(i, i, 1);
+    at = &at->add<Drawing>();
+  }
+  std::size_t deepest = 0;
+  for (auto e : walk(deep))
+    deepest = std::max(deepest, e.depth);
+  std::cout << "nested 100 deep: " << std::ranges::distance(flatten(deep))
+            << " leaves, deepest at " << deepest << '\n';
+
+  // 1000 sub-drawings of 1000 sub-drawings of 10 shapes.
+  Drawing d;
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto &mid = d.add<Drawing>();
+    for (int k = 0; k < 1000; ++k)
+    {
+      auto &leaf = mid.add<Drawing>();
+      for (int j = 0; j < 10; ++j)
+        switch (j % 3)
+        {
+          case 0: leaf.add<Circle>(i, k, j); break;
+          case 1: leaf.add<Triangle>(i, k, j); break;
+          case 2: leaf.add<Rectangle>(i, k, j, j + 1); break;
+        }
+    }
+  }
+  std::cout << '\n';
+
+  measure("visitor", [&] {
+    RectangleArea v;
+    v(d);
+    return v.area();
+  });
+
+  measure("flatten | of_type", [&] {
+    long long area = 0;
+    for (auto &r : flatten(d) | of_type<Rectangle>)
+    {
+      auto [w, h] = r.getSize();
+      area += (long long)w * h;
+    }
+    return area;
+  });
+
+  measure("ranges::count_if", [&] {
+    return std::ranges::count_if(flatten(d), [](const Shape &s) {
+      return std::holds_alternative<Circle>(s);
+    });
+  });
+
+  measure("deepest shape", [&] {
+    auto depths = walk(d) | std::views::transform([](Entry e) { return e.depth; });
+    return std::ranges::max(depths);
+  });
+
+  return 0;
+}
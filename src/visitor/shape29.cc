@@ -0,0 +1,229 @@
+/*
+clang++ -std=c++20 -O2 -pthread shape29.cc \
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void reserve(std::size_t n) { m_shape.reserve(n); }
+  std::size_t size() const { return m_shape.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() const { return m_shape.begin(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+// Builds one drawing from many threads without a lock. Each producer adds
+// to a shard of its own, an ordinary Drawing, so nothing is shared while
+// shapes are added. finalize() then makes the shards the sub-drawings of
+// one drawing, in the order of their numbers, so the result does not
+// depend on which thread ran when. No shape is moved to do that.
+//
+// A shard may only be used by one thread at a time. Shards sit on cache
+// lines of their own, so producers do not slow each other down by
+// writing next to each other.
+class Builder {
+public:
+
+  Builder(std::size_t shards) : m_shard(shards) {}
+
+  Drawing &shard(std::size_t i) { return m_shard[i].drawing; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Once every producer is done.
+  Drawing finalize()
+  {
+    Drawing d;
+    d.reserve(m_shard.size());
+    for (auto &s : m_shard)
+      if (s.drawing.size())
+        d.add<Drawing>(std::move(s.drawing));
+    return d;
+  }
+
+//---------------------------------------------------------
+private:
+  struct alignas(64) Shard {
+    Drawing drawing;
+  };
+
+  std::vector<Shard> m_shard;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Shape i of the input, whichever thread adds it.
+void add(Drawing &d, int i)
+{
+  switch (i % 3)
+  {
+    case 0: d.add<Circle>(i, i, 5); break;
+    case 1: d.add<Triangle>(i, i, 7); break;
+    case 2: d.add<Rectangle>(i, i, 3, 4); break;
+  }
+}
+
+// Depends on the order of the shapes, but not on how they are grouped
+// into sub-drawings.
+void checksum(const Drawing &d, std::size_t &h)
+{
+  for (auto &s : d)
+    std::visit([&](auto &shape) {
+      if constexpr (std::is_same_v<std::decay_t<decltype(shape)>, Drawing>)
+        checksum(shape, h);
+      else
+        h = h * 31 + std::get<0>(shape.getPosition());
+    }, s);
+}
+
+std::size_t checksum(const Drawing &d)
+{
+  std::size_t h = 0;
+  checksum(d, h);
+  return h;
+}
+
+// Runs 'threads' producers over [0, n), each on one contiguous part; the
+// last part also takes what does not divide evenly.
+template<typename F>
+void produce(int threads, int n, F f)
+{
+  std::vector<std::jthread> producers;
+  for (int t = 0; t < threads; ++t)
+    producers.emplace_back([=] {
+      f(t, t * (n / threads), t + 1 == threads ? n : (t + 1) * (n / threads));
+    });
+}
+
+template<typename F>
+double millis(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main()
+{
+  const int n = 8000000;
+
+  Drawing serial;
+  for (int i = 0; i < n; ++i)
+    add(serial, i);
+
+  std::cout << std::thread::hardware_concurrency() << " hardware threads\n";
+
+  for (int threads : {1, 2, 3, 4, 8})
+  {
+    // Every add() behind one lock.
+    std::mutex m;
+    Drawing locked;
+    auto locked_ms = millis([&] {
+      produce(threads, n, [&](int, int first, int last) {
+        for (int i = first; i < last; ++i)
+        {
+          std::lock_guard lock(m);
+          add(locked, i);
+        }
+      });
+    });
+
+    // A shard per producer.
+    Builder b(threads);
+    Drawing d;
+    auto sharded_ms = millis([&] {
+      produce(threads, n, [&](int t, int first, int last) {
+        for (int i = first; i < last; ++i)
+          add(b.shard(t), i);
+      });
+      d = b.finalize();
+    });
+
+    std::cout << threads << " threads: mutex " << std::fixed << std::setprecision(1)
+              << std::setw(6) << locked_ms << " ms, "
+              << std::setw(6) << n / locked_ms / 1000 << " M shapes/s; sharded "
+              << std::setw(6) << sharded_ms << " ms, "
+              << std::setw(6) << n / sharded_ms / 1000 << " M shapes/s; same as serial: "
+              << std::boolalpha << (checksum(d) == checksum(serial)) << '\n';
+  }
+
+  return 0;
+}
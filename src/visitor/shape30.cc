@@ -0,0 +1,471 @@
+/*
+clang++ -std=c++20 -O2 -pthread shape30.cc \
+  -I ~/opt/include \
+  -L ~/opt/lib -lsfml-graphics -lsfml-window -lsfml-system
+
+  Press <Esc> to close the graphic window.
+  Run with --headless to only run the check against a fake target.
+*/
+
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <SFML/Graphics.hpp>
+
+
+//=========================================================
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &emplace_back(A&&... a)
+  {
+    auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
+      std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  void reserve(std::size_t n) { m_composite.reserve(n); }
+
+  value_type &operator[](std::size_t i) { return m_composite[i]; }
+  std::size_t size() const { return m_composite.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : m_composite)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<value_type> m_composite;
+};
+
+
+
+//===================================================================
+using Color = sf::Color;
+using Pos = sf::Vector2f;
+using V2f = sf::Vector2f;
+
+using Circle = sf::CircleShape;
+using Rectangle = sf::RectangleShape;
+
+//---------------------------------------------------------
+class Triangle : public Circle {
+public:
+  Triangle(float radius) : Circle (radius, 3) {}
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setRadius(s.getRadius() * m_ratio); }
+  void operator()(Triangle &s) { s.setRadius(s.getRadius() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto sz = s.getSize();
+    s.setSize(V2f{sz.x * m_ratio, sz.y * m_ratio});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+  // Scaling by one ratio and then by another is scaling by their product.
+  void then(const Scale &next) { m_ratio *= next.m_ratio; }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+//=========================================================
+class FillColor {
+public:
+
+  FillColor(Color c) : m_color(c) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setFillColor(m_color); }
+  void operator()(Triangle &s) { s.setFillColor(m_color); }
+  void operator()(Rectangle &s) { s.setFillColor(m_color); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+  // The second colour covers the first.
+  void then(const FillColor &next) { m_color = next.m_color; }
+
+//---------------------------------------------------------
+private:
+  Color m_color;
+};
+
+
+//=========================================================
+// A visitor to apply to the sub-drawing at 'path', given as the position
+// of each sub-drawing in the one above it. An empty path is the whole
+// drawing.
+struct Command {
+  std::vector<std::size_t> path;
+  std::variant<Scale, FillColor> op;
+};
+
+
+//=========================================================
+// A queue that any number of threads push to and one thread empties. A
+// push is a single compare-and-swap on the head of a linked list, retried
+// if another push got there first, so producers never wait for a lock.
+// drain() takes the whole list at once and reverses it, to hand the
+// values over in the order they were pushed.
+template<typename T>
+class CommandQueue {
+public:
+
+  CommandQueue() = default;
+  CommandQueue(const CommandQueue &) = delete;
+
+  ~CommandQueue() { drain([](T &&) {}); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void push(T value)
+  {
+    auto n = new Node{std::move(value), m_head.load(std::memory_order_relaxed)};
+    while (!m_head.compare_exchange_weak(n->next, n, std::memory_order_release,
+        std::memory_order_relaxed))
+      ;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Calls f with each value pushed so far, oldest first. Only one thread
+  // may drain.
+  template<typename F>
+  std::size_t drain(F f)
+  {
+    Node *n = m_head.exchange(nullptr, std::memory_order_acquire);
+
+    Node *oldest = nullptr;
+    while (n)
+      oldest = std::exchange(n, std::exchange(n->next, oldest));
+
+    std::size_t count = 0;
+    while (oldest)
+    {
+      f(std::move(oldest->value));
+      delete std::exchange(oldest, oldest->next);
+      ++count;
+    }
+    return count;
+  }
+
+//---------------------------------------------------------
+private:
+  struct Node {
+    T value;
+    Node *next;
+  };
+
+  std::atomic<Node *> m_head = nullptr;
+};
+
+
+
+//---------------------------------------------------------
+class Window : public sf::RenderWindow {
+public:
+  Window(const int width, const int height, const std::string &title)
+    : sf::RenderWindow(sf::VideoMode(width, height), title.c_str())
+  {
+    setVerticalSyncEnabled(true);
+  }
+};
+
+
+//---------------------------------------------------------
+// Stands in for a Window in tests: counts what would have been drawn.
+// Closes itself after a number of frames.
+class FakeTarget {
+public:
+
+  FakeTarget(int frames) : m_max(frames) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool isOpen() const { return m_frames < m_max; }
+  void close() { m_max = m_frames; }
+
+  bool pollEvent(sf::Event &) { return false; }
+
+  void clear() {}
+  void draw(const sf::Drawable &) { ++m_draws; }
+  void display() { ++m_frames; }
+
+  int frames() const { return m_frames; }
+  int draws() const { return m_draws; }
+
+//---------------------------------------------------------
+private:
+  int m_max, m_draws = 0, m_frames = 0;
+};
+
+
+//=========================================================
+// Draws a drawing on any Target with the RenderWindow interface. Other
+// threads do not touch the drawing; they push Commands, and the viewer
+// applies them between frames.
+template<typename Target>
+class Viewer {
+public:
+
+  Viewer(Target &target) : m_target(target) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { m_target.draw(s); }
+  void operator()(Triangle &s) { m_target.draw(s); }
+  void operator()(Rectangle &s) { m_target.draw(s); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Safe to call from any thread.
+  void push(Command c) { m_commands.push(std::move(c)); }
+
+  // Applies what was pushed since the last call, merged where possible.
+  // Returns the number of commands applied.
+  std::size_t apply(Drawing &d)
+  {
+    m_batch.clear();
+    m_commands.drain([&](Command &&c) { merge(std::move(c)); });
+
+    for (auto &c : m_batch)
+    {
+      Drawing *target = &d;
+      for (auto i : c.path)
+        target = &std::get<Drawing>((*target)[i]);
+      std::visit([&](auto &op) { op(*target); }, c.op);
+    }
+    return m_batch.size();
+  }
+
+  void frame(Drawing &d)
+  {
+    apply(d);
+    m_target.clear();
+    (*this)(d);
+    m_target.display();
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Commands can arrive at any time, so the loop polls rather than waits
+  // for events, and redraws once per vertical sync.
+  void show(Drawing &d)
+  {
+    while (m_target.isOpen())
+    {
+      sf::Event event;
+      while (m_target.pollEvent(event))
+        handle(event);
+
+      if (m_target.isOpen())
+        frame(d);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  void handle(const sf::Event &event)
+  {
+    switch(event.type)
+    {
+      case sf::Event::Closed: m_target.close(); break;
+      case sf::Event::KeyPressed:
+        if (event.key.code == sf::Keyboard::Escape)
+          m_target.close();
+      break;
+
+      default: break;
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Folds 'c' into an earlier command of the batch on the same
+  // sub-drawing. Scale and FillColor change different things, so a Scale
+  // can be moved back past anything. A FillColor can not be moved back
+  // past another FillColor on a sub-drawing that contains, or is inside,
+  // its own.
+  void merge(Command &&c)
+  {
+    for (auto it = m_batch.rbegin(); it != m_batch.rend(); ++it)
+    {
+      if (it->path == c.path && it->op.index() == c.op.index())
+      {
+        std::visit([&](auto &op) {
+          op.then(std::get<std::decay_t<decltype(op)>>(c.op));
+        }, it->op);
+        return;
+      }
+
+      if (std::holds_alternative<FillColor>(c.op) &&
+          std::holds_alternative<FillColor>(it->op) && nested(it->path, c.path))
+        break;
+    }
+    m_batch.push_back(std::move(c));
+  }
+
+  static bool nested(const std::vector<std::size_t> &a, const std::vector<std::size_t> &b)
+  {
+    auto n = std::min(a.size(), b.size());
+    return std::equal(a.begin(), a.begin() + n, b.begin());
+  }
+
+  Target &m_target;
+  CommandQueue<Command> m_commands;
+  std::vector<Command> m_batch;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// 'n' sub-drawings of 1000 circles with a radius of 10.
+void rows(Drawing &d, int n)
+{
+  for (int k = 0; k < n; ++k)
+  {
+    auto &row = d.emplace_back<Drawing>();
+    row.reserve(1000);
+    for (int i = 0; i < 1000; ++i)
+    {
+      auto &c = row.emplace_back<Circle>(10.f);
+      c.setPosition(Pos(i % 40 * 20, k * 60 + i / 40 * 2));
+    }
+  }
+}
+
+// Producer t gives its row a new colour with every tenth command, and
+// otherwise scales it up and down again. Every seventh scale is of the
+// whole drawing instead. For an even number of scales of each, the sizes
+// end up as they were.
+template<typename Target>
+void produce(Viewer<Target> &viewer, std::size_t t, int commands)
+{
+  int scales[2] = {0, 0};
+  for (int i = 0; i < commands; ++i)
+  {
+    if (i % 10 == 0)
+    {
+      viewer.push({{t}, FillColor(Color(t, i % 256, 0))});
+      continue;
+    }
+
+    bool all = (scales[0] + scales[1]) % 7 == 0;
+    float ratio = scales[all]++ % 2 ? 0.5f : 2.f;
+    if (all)
+      viewer.push({{}, Scale(ratio)});
+    else
+      viewer.push({{t}, Scale(ratio)});
+  }
+}
+
+template<typename F>
+double micro(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main(int argc, char *argv[])
+{
+  // Headless: four producers push 100000 commands each while frames are
+  // drawn; then the drawing is checked against what they asked for.
+  const int producers = 4, commands = 100000;
+  Drawing d;
+  rows(d, producers);
+
+  FakeTarget fake(1 << 30);
+  Viewer<FakeTarget> headless(fake);
+
+  std::atomic<int> running = producers;
+  std::vector<std::jthread> threads;
+  for (int t = 0; t < producers; ++t)
+    threads.emplace_back([&, t] {
+      produce(headless, t, commands);
+      --running;
+    });
+
+  std::size_t applied = 0;
+  double longest = 0, total = 0;
+  while (running)
+  {
+    auto us = micro([&] { applied += headless.apply(d); });
+    longest = std::max(longest, us);
+    total += us;
+    headless.frame(d);
+  }
+  threads.clear();
+  total += micro([&] { applied += headless.apply(d); });
+
+  bool ok = true;
+  for (int t = 0; t < producers; ++t)
+  {
+    auto &c = std::get<Circle>(std::get<Drawing>(d[t])[0]);
+    int last = (commands - 1) / 10 * 10;
+    ok = ok && c.getRadius() == 10.f && c.getFillColor() == Color(t, last % 256, 0);
+  }
+
+  std::cout << producers * commands << " commands pushed, " << applied
+            << " applied after merging, over " << fake.frames() << " frames\n"
+            << "apply(): " << total * 1000 / (producers * commands)
+            << " ns per command pushed, longest " << longest << " us\n"
+            << "sizes and colours as expected: " << std::boolalpha << ok << '\n';
+
+  if (argc > 1 && std::string(argv[1]) == "--headless")
+    return ok ? 0 : 1;
+
+
+  // A producer thread makes the rows pulse until the window is closed.
+  Drawing drawing;
+  rows(drawing, 4);
+
+  Window window(800, 300, "visitor");
+  Viewer<Window> viewer(window);
+
+  std::jthread pulse([&](std::stop_token stop) {
+    for (int i = 0; !stop.stop_requested(); ++i)
+    {
+      std::size_t row = i % 4;
+      viewer.push({{row}, Scale(i / 4 % 2 ? 0.8f : 1.25f)});
+      viewer.push({{row}, FillColor(Color(i * 40 % 256, 255 - i * 40 % 256, 128))});
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  });
+
+  viewer.show(drawing);
+
+  return 0;
+}
@@ -0,0 +1,502 @@
+/*
+clang++ -std=c++20 -O2 shape31.cc \
+  -I ~/opt/include \
+  -L ~/opt/lib -lsfml-graphics -lsfml-window -lsfml-system
+
+  Press <Esc> to close the graphic window.
+  Run with --headless to only run the check against a fake target.
+*/
+
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+#include <SFML/Graphics.hpp>
+
+
+//=========================================================
+// The Composite remembers if it may have changed: anything that got at
+// its shapes through the mutable accept() or operator[] might have, and
+// so might a new shape. A sub-drawing can only be changed through its
+// parent, so the parent is marked as well.
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &emplace_back(A&&... a)
+  {
+    m_dirty = true;
+    auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
+      std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  void reserve(std::size_t n) { m_composite.reserve(n); }
+
+  value_type &operator[](std::size_t i) { m_dirty = true; return m_composite[i]; }
+  const value_type &operator[](std::size_t i) const { return m_composite[i]; }
+  std::size_t size() const { return m_composite.size(); }
+
+  bool dirty() const { return m_dirty; }
+  void clean() { m_dirty = false; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    m_dirty = true;
+    for (auto &s : m_composite)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<value_type> m_composite;
+  bool m_dirty = true;
+};
+
+
+
+//===================================================================
+using Color = sf::Color;
+using Pos = sf::Vector2f;
+using V2f = sf::Vector2f;
+
+
+//=========================================================
+// A shape that keeps its parameters and builds its vertices only when
+// they are needed, to draw it or to get its bounds. sf::Shape rebuilds
+// them in every setter, so a chain of edits builds them once per edit.
+//
+// Derived classes provide points(), the outline in local coordinates, and
+// call changed() when a parameter that affects it is set.
+template<typename Derived>
+class Lazy : public sf::Drawable {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Moving a shape only changes its transform, as in SFML.
+  void setPosition(Pos p) { m_position = p; }
+  const Pos &getPosition() const { return m_position; }
+
+  void setFillColor(Color c) { m_fill = c; changed(); }
+  const Color &getFillColor() const { return m_fill; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  sf::FloatRect getGlobalBounds() const
+  {
+    rebuild();
+    return {m_bounds.left + m_position.x, m_bounds.top + m_position.y,
+            m_bounds.width, m_bounds.height};
+  }
+
+  // A triangle fan: the centre, then the outline, closed.
+  const sf::VertexArray &vertices() const
+  {
+    rebuild();
+    return m_vertices;
+  }
+
+  bool dirty() const { return m_dirty; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void rebuild() const
+  {
+    if (!m_dirty)
+      return;
+
+    m_vertices.clear();
+    m_vertices.setPrimitiveType(sf::TriangleFan);
+    m_vertices.append(sf::Vertex(V2f(0, 0), m_fill));
+
+    float left = INFINITY, top = INFINITY, right = -INFINITY, bottom = -INFINITY;
+    static_cast<const Derived *>(this)->points([&](V2f p) {
+      m_vertices.append(sf::Vertex(p, m_fill));
+      left = std::min(left, p.x);
+      top = std::min(top, p.y);
+      right = std::max(right, p.x);
+      bottom = std::max(bottom, p.y);
+    });
+    m_vertices.append(m_vertices[1]);
+
+    m_vertices[0].position = V2f((left + right) / 2, (top + bottom) / 2);
+    m_bounds = {left, top, right - left, bottom - top};
+    m_dirty = false;
+  }
+
+//---------------------------------------------------------
+protected:
+  void changed() { m_dirty = true; }
+
+  void draw(sf::RenderTarget &target, sf::RenderStates states) const override
+  {
+    states.transform.translate(m_position.x, m_position.y);
+    target.draw(vertices(), states);
+  }
+
+private:
+  Pos m_position;
+  Color m_fill = Color::White;
+
+  mutable sf::VertexArray m_vertices;
+  mutable sf::FloatRect m_bounds;
+  mutable bool m_dirty = true;
+};
+
+
+//=========================================================
+class Circle : public Lazy<Circle> {
+public:
+
+  Circle(float radius, std::size_t points = 30) : m_radius(radius), m_points(points) {}
+
+  void setRadius(float radius) { m_radius = radius; changed(); }
+  float getRadius() const { return m_radius; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // The same points as sf::CircleShape.
+  template<typename F>
+  void points(F f) const
+  {
+    for (std::size_t i = 0; i < m_points; ++i)
+    {
+      float angle = i * 2 * M_PI / m_points - M_PI / 2;
+      f(V2f(m_radius + std::cos(angle) * m_radius, m_radius + std::sin(angle) * m_radius));
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  float m_radius;
+  std::size_t m_points;
+};
+
+//---------------------------------------------------------
+class Triangle : public Circle {
+public:
+  Triangle(float radius) : Circle (radius, 3) {}
+};
+
+//=========================================================
+class Rectangle : public Lazy<Rectangle> {
+public:
+
+  Rectangle(V2f size) : m_size(size) {}
+
+  void setSize(V2f size) { m_size = size; changed(); }
+  const V2f &getSize() const { return m_size; }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename F>
+  void points(F f) const
+  {
+    f(V2f(0, 0));
+    f(V2f(m_size.x, 0));
+    f(V2f(m_size.x, m_size.y));
+    f(V2f(0, m_size.y));
+  }
+
+//---------------------------------------------------------
+private:
+  V2f m_size;
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+
+//=========================================================
+class Scale {
+public:
+
+  Scale(float ratio) : m_ratio(ratio) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setRadius(s.getRadius() * m_ratio); }
+  void operator()(Triangle &s) { s.setRadius(s.getRadius() * m_ratio); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto sz = s.getSize();
+    s.setSize(V2f{sz.x * m_ratio, sz.y * m_ratio});
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  float m_ratio;
+};
+
+//=========================================================
+class FillColor {
+public:
+
+  FillColor(Color c) : m_color(c) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s) { s.setFillColor(m_color); }
+  void operator()(Triangle &s) { s.setFillColor(m_color); }
+  void operator()(Rectangle &s) { s.setFillColor(m_color); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  Color m_color;
+};
+
+
+//=========================================================
+// Runs a visitor, then rebuilds each shape it touched at once, the way
+// sf::Shape does. Only here to compare with.
+template<typename V>
+class Eager {
+public:
+
+  Eager(V visitor) : m_visitor(visitor) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename S>
+  void operator()(S &s)
+  {
+    m_visitor(s);
+    s.rebuild();
+  }
+
+  void operator()(Drawing &d) { d.accept(*this); }
+
+//---------------------------------------------------------
+private:
+  V m_visitor;
+};
+
+//=========================================================
+// Rebuilds every shape that needs it, in one pass, e.g. between frames so
+// that drawing does not have to. Sub-drawings that have not changed since
+// the last pass are skipped without looking at their shapes.
+class Rebuild {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s) { s.rebuild(); }
+  void operator()(const Triangle &s) { s.rebuild(); }
+  void operator()(const Rectangle &s) { s.rebuild(); }
+
+  void operator()(Drawing &d)
+  {
+    if (!d.dirty())
+      return;
+    d.accept(*this);
+    d.clean();
+  }
+};
+
+
+
+//---------------------------------------------------------
+class Window : public sf::RenderWindow {
+public:
+  Window(const int width, const int height, const std::string &title)
+    : sf::RenderWindow(sf::VideoMode(width, height), title.c_str())
+  {
+    setVerticalSyncEnabled(true);
+  }
+};
+
+
+//---------------------------------------------------------
+// Stands in for a Window in tests: takes the vertices of what would have
+// been drawn, so that they are built, and counts them. Closes itself after
+// one frame.
+class FakeTarget {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool isOpen() const { return m_open; }
+  void close() { m_open = false; }
+
+  bool waitEvent(sf::Event &) { close(); return false; }
+
+  void clear() {}
+
+  template<typename S>
+  void draw(const S &s) { m_vertices += s.vertices().getVertexCount(); }
+
+  void display() {}
+
+  std::size_t vertices() const { return m_vertices; }
+
+//---------------------------------------------------------
+private:
+  bool m_open = true;
+  std::size_t m_vertices = 0;
+};
+
+
+//=========================================================
+template<typename Target>
+class Viewer {
+public:
+
+  Viewer(Target &target) : m_target(target) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s) { m_target.draw(s); }
+  void operator()(const Triangle &s) { m_target.draw(s); }
+  void operator()(const Rectangle &s) { m_target.draw(s); }
+
+  // Drawing does not change anything, so it goes through the shapes
+  // without marking the drawing.
+  void operator()(const Drawing &d)
+  {
+    for (std::size_t i = 0; i < d.size(); ++i)
+      std::visit(*this, d[i]);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void frame(Drawing &d)
+  {
+    m_target.clear();
+    (*this)(d);
+    m_target.display();
+  }
+
+  void show(Drawing &d)
+  {
+    frame(d);
+    while (m_target.isOpen())
+    {
+      sf::Event event;
+      if (!m_target.waitEvent(event))
+        continue;
+
+      if (event.type == sf::Event::Closed ||
+          (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape))
+        m_target.close();
+      else if (event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus)
+        frame(d);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  Target &m_target;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// 200 sub-drawings of 1000 shapes.
+Drawing make()
+{
+  Drawing d;
+  d.reserve(200);
+  for (int k = 0; k < 200; ++k)
+  {
+    auto &sub = d.emplace_back<Drawing>();
+    sub.reserve(1000);
+    for (int i = 0; i < 1000; ++i)
+    {
+      auto pos = Pos(i % 40 * 20, k * 60 + i / 40 * 2);
+      if (i % 10 == 0)
+        sub.emplace_back<Rectangle>(V2f{8, 4}).setPosition(pos);
+      else
+        sub.emplace_back<Circle>(5.f).setPosition(pos);
+    }
+  }
+  return d;
+}
+
+template<typename F>
+double milli(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - t0).count();
+}
+
+
+//=========================================================
+int main(int argc, char *argv[])
+{
+  // Headless: four edits in a row to 200000 shapes, then a frame.
+  Drawing eager = make(), lazy = make();
+  FakeTarget fake_eager, fake_lazy;
+  Viewer<FakeTarget> view_eager(fake_eager), view_lazy(fake_lazy);
+  Rebuild rebuild;
+
+  view_eager.frame(eager);
+  view_lazy.frame(lazy);
+  rebuild(lazy);
+
+  auto eager_ms = milli([&] {
+    Eager(Scale(1.5f))(eager);
+    Eager(FillColor(Color::Red))(eager);
+    Eager(Scale(0.5f))(eager);
+    Eager(Scale(2.f))(eager);
+    view_eager.frame(eager);
+  });
+
+  double edits_ms = 0, rebuild_ms = 0, frame_ms = 0;
+  edits_ms = milli([&] {
+    Scale(1.5f)(lazy);
+    FillColor(Color::Red)(lazy);
+    Scale(0.5f)(lazy);
+    Scale(2.f)(lazy);
+  });
+  rebuild_ms = milli([&] { rebuild(lazy); });
+  frame_ms = milli([&] { view_lazy.frame(lazy); });
+
+  std::cout << "rebuilt in every setter: " << eager_ms << " ms\n"
+            << "lazy: edits " << edits_ms << " ms, rebuild " << rebuild_ms
+            << " ms, frame " << frame_ms << " ms\n";
+
+  // One sub-drawing changed: the rebuild pass skips the other 199.
+  Scale(1.1f)(std::get<Drawing>(lazy[7]));
+  auto one_ms = milli([&] { rebuild(lazy); });
+  auto &changed = std::get<Circle>(std::get<Drawing>(std::as_const(lazy)[7])[1]);
+  std::cout << "rebuild after changing one sub-drawing: " << one_ms << " ms, rebuilt: "
+            << std::boolalpha << !changed.dirty() << '\n';
+
+  auto &a = std::get<Circle>(std::get<Drawing>(eager[3])[1]);
+  auto &b = std::get<Circle>(std::get<Drawing>(lazy[3])[1]);
+  auto ba = a.getGlobalBounds(), bb = b.getGlobalBounds();
+  bool ok = fake_eager.vertices() == fake_lazy.vertices() &&
+    ba.left == bb.left && ba.width == bb.width && a.getFillColor() == b.getFillColor();
+  std::cout << "same vertices and bounds: " << ok << '\n';
+
+  if (argc > 1 && std::string(argv[1]) == "--headless")
+    return ok ? 0 : 1;
+
+
+  Drawing d;
+  for (int k = 0; k < 5; ++k)
+  {
+    auto &row = d.emplace_back<Drawing>();
+    for (int i = 0; i < 20; ++i)
+      row.emplace_back<Circle>(8.f).setPosition(Pos(i * 20, k * 40));
+  }
+  Scale(1.2f)(d);
+  FillColor(Color::Green)(std::get<Drawing>(d[2]));
+
+  Window window(400, 200, "visitor");
+  Viewer<Window> viewer(window);
+  viewer.show(d);
+
+  return 0;
+}
@@ -0,0 +1,386 @@
+/*
+clang++ -std=c++20 -O2 shape32.cc \
+  -I ~/opt/include \
+  -L ~/opt/lib -lsfml-graphics -lsfml-window -lsfml-system
+
+  Press <+>/<-> to zoom in and out and <Esc> to close the graphic window.
+  Run with --headless to only run the check against a fake target.
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <random>
+
+#include <SFML/Graphics.hpp>
+
+
+//=========================================================
+template <typename ...Leaf>
+class Composite {
+public:
+  using value_type = std::variant<Leaf..., Composite>;
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &emplace_back(A&&... a)
+  {
+    auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
+      std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  void reserve(std::size_t n) { m_composite.reserve(n); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template <typename T>
+  void accept(T &visitor)
+  {
+    for (auto &s : m_composite)
+    {
+      std::visit(visitor, s);
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<value_type> m_composite;
+};
+
+
+
+//===================================================================
+using Color = sf::Color;
+using Pos = sf::Vector2f;
+using V2f = sf::Vector2f;
+
+using Circle = sf::CircleShape;
+using Rectangle = sf::RectangleShape;
+
+//---------------------------------------------------------
+class Triangle : public Circle {
+public:
+  Triangle(float radius) : Circle (radius, 3) {}
+};
+
+
+using Drawing = Composite<Circle, Triangle, Rectangle>;
+
+
+//=========================================================
+// Chooses how many points to draw a circle with, from its radius on the
+// screen. Between two points the outline is cut by a straight edge, which
+// is at most r (1 - cos(pi / n)) away from the true circle; n is the
+// smallest count that keeps that within 'tolerance' pixels.
+//
+// The points of a unit circle are kept for each size bucket, half an
+// octave of radius wide, and computed for the largest radius in the
+// bucket. Nothing here needs a display.
+class Tessellator {
+public:
+
+  Tessellator(float tolerance = 0.25f, std::size_t min = 4, std::size_t max = 1024)
+    : m_tolerance(tolerance), m_min(min), m_max(max) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Radius in pixels. Worked out in double and clamped before it is made
+  // a count: it is infinite for a tolerance of 0, and in float 1 - tol / r
+  // rounds to 1 for a large enough radius.
+  std::size_t count(float radius) const
+  {
+    if (m_tolerance <= 0)
+      return m_max;
+
+    double n = m_min;
+    if (radius > m_tolerance)
+      n = std::ceil(M_PI / std::acos(1 - double(m_tolerance) / radius));
+    return std::clamp(n, double(m_min), double(m_max));
+  }
+
+  static float error(float radius, std::size_t n) { return radius * (1 - std::cos(M_PI / n)); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  const std::vector<V2f> &unit(float radius)
+  {
+    int bucket = std::max(-8, int(std::ceil(2 * std::log2(std::max(radius, 1e-3f)))));
+    auto &points = m_bucket[bucket];
+    if (points.empty())
+    {
+      auto n = count(std::exp2(bucket / 2.f));
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        float angle = i * 2 * M_PI / n - M_PI / 2;
+        points.push_back(V2f(std::cos(angle), std::sin(angle)));
+      }
+    }
+    return points;
+  }
+
+  std::size_t buckets() const { return m_bucket.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Appends a circle as triangles, in drawing units, for a view of 'zoom'
+  // pixels per unit.
+  void append(sf::VertexArray &out, V2f centre, float radius, float zoom, Color color)
+  {
+    auto &points = unit(radius * zoom);
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+      auto &a = points[i];
+      auto &b = points[(i + 1) % points.size()];
+      out.append(sf::Vertex(centre, color));
+      out.append(sf::Vertex(centre + a * radius, color));
+      out.append(sf::Vertex(centre + b * radius, color));
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  float m_tolerance;
+  std::size_t m_min, m_max;
+  std::map<int, std::vector<V2f>> m_bucket;
+};
+
+
+
+//---------------------------------------------------------
+class Window : public sf::RenderWindow {
+public:
+  Window(const int width, const int height, const std::string &title)
+    : sf::RenderWindow(sf::VideoMode(width, height), title.c_str())
+  {
+    setVerticalSyncEnabled(true);
+  }
+};
+
+
+//---------------------------------------------------------
+// Stands in for a Window in tests: counts the draw calls and vertices that
+// would have been drawn.
+class FakeTarget {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool isOpen() const { return m_open; }
+  void close() { m_open = false; }
+
+  bool pollEvent(sf::Event &) { return false; }
+  bool waitEvent(sf::Event &) { close(); return false; }
+
+  sf::Vector2u getSize() const { return {800, 600}; }
+  void setView(const sf::View &) {}
+
+  void clear() {}
+  void draw(const sf::Drawable &) { ++m_draws; }
+  void draw(const sf::VertexArray &v) { ++m_draws; m_vertices += v.getVertexCount(); }
+  void display() {}
+
+  std::size_t draws() const { return m_draws; }
+  std::size_t vertices() const { return m_vertices; }
+
+//---------------------------------------------------------
+private:
+  bool m_open = true;
+  std::size_t m_draws = 0, m_vertices = 0;
+};
+
+
+//=========================================================
+// Draws a drawing on any Target with the RenderWindow interface. Circles
+// are not drawn as sf::CircleShapes, with their fixed number of points,
+// but tessellated for their size on the screen and collected into a
+// vertex array. The array is drawn before any other shape, and at the end
+// of the frame, so shapes still cover each other in drawing order.
+template<typename Target>
+class Viewer {
+public:
+
+  Viewer(Target &target, Tessellator &tessellator)
+    : m_target(target), m_tessellator(tessellator), m_batch(sf::Triangles) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto r = s.getRadius();
+    m_tessellator.append(m_batch, s.getPosition() + V2f(r, r), r, m_zoom, s.getFillColor());
+  }
+
+  void operator()(Triangle &s) { flush(); m_target.draw(s); }
+  void operator()(Rectangle &s) { flush(); m_target.draw(s); }
+  void operator()(Drawing &d) { d.accept(*this); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Pixels per drawing unit.
+  void zoom(float zoom)
+  {
+    m_zoom = zoom;
+    auto size = m_target.getSize();
+    m_target.setView(sf::View(sf::FloatRect(0, 0, size.x / zoom, size.y / zoom)));
+  }
+
+  void frame(Drawing &d)
+  {
+    m_target.clear();
+    (*this)(d);
+    flush();
+    m_target.display();
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void show(Drawing &d)
+  {
+    bool dirty = true;
+    while (m_target.isOpen())
+    {
+      sf::Event event;
+      if (!dirty && m_target.waitEvent(event))
+        dirty = handle(event);
+
+      while (m_target.pollEvent(event))
+        dirty = handle(event) || dirty;
+
+      if (dirty && m_target.isOpen())
+      {
+        frame(d);
+        dirty = false;
+      }
+    }
+  }
+
+//---------------------------------------------------------
+private:
+  void flush()
+  {
+    if (m_batch.getVertexCount())
+    {
+      m_target.draw(m_batch);
+      m_batch.clear();
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  bool handle(const sf::Event &event)
+  {
+    switch(event.type)
+    {
+      case sf::Event::Closed: m_target.close(); break;
+      case sf::Event::Resized:
+      case sf::Event::GainedFocus: return true;
+      case sf::Event::KeyPressed:
+        switch (event.key.code)
+        {
+          case sf::Keyboard::Escape: m_target.close(); break;
+          case sf::Keyboard::Add: zoom(m_zoom * 1.25f); return true;
+          case sf::Keyboard::Subtract: zoom(m_zoom * 0.8f); return true;
+          default: break;
+        }
+      break;
+
+      default: break;
+    }
+    return false;
+  }
+
+  Target &m_target;
+  Tessellator &m_tessellator;
+  sf::VertexArray m_batch;
+  float m_zoom = 1;
+};
+
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// 100000 small circles, 1 to 4 units across, and a few large ones.
+void scene(Drawing &d)
+{
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> pos(0, 800), radius(0.5f, 2.f);
+
+  auto &small = d.emplace_back<Drawing>();
+  small.reserve(100000);
+  for (int i = 0; i < 100000; ++i)
+    small.emplace_back<Circle>(radius(rng)).setPosition(Pos(pos(rng), pos(rng)));
+
+  auto &large = d.emplace_back<Drawing>();
+  for (int i = 0; i < 10; ++i)
+  {
+    auto &c = large.emplace_back<Circle>(100.f + 20 * i);
+    c.setPosition(Pos(i * 60, i * 40));
+    c.setFillColor(Color::Blue);
+  }
+}
+
+
+//=========================================================
+int main(int argc, char *argv[])
+{
+  // Headless: the tessellator on its own...
+  Tessellator adaptive;
+  bool ok = true;
+  for (float r = 0.1f; r < 5000; r *= 1.1f)
+  {
+    // Within tolerance, with the fewest points that are, or the fewest
+    // allowed; the bucket may only add points.
+    auto n = adaptive.count(r);
+    ok = ok && Tessellator::error(r, n) <= 0.25f + 1e-4f
+            && (n == 4 || Tessellator::error(r, n - 1) > 0.25f)
+            && adaptive.unit(r).size() >= n;
+  }
+  std::cout << "tolerance kept from 0.1 to 5000 pixels: " << std::boolalpha << ok
+            << ", " << adaptive.buckets() << " buckets; points for a radius of";
+  for (float r : {1.f, 10.f, 100.f, 1000.f})
+    std::cout << ' ' << r << ": " << adaptive.count(r);
+  std::cout << '\n';
+
+  // ...and a scene drawn at a few zoom levels, against a fixed 30 points.
+  Drawing d;
+  scene(d);
+
+  Tessellator fixed(0, 30, 30);
+  for (float zoom : {0.5f, 1.f, 4.f})
+  {
+    FakeTarget fake_fixed, fake_adaptive;
+    Viewer<FakeTarget> v_fixed(fake_fixed, fixed), v_adaptive(fake_adaptive, adaptive);
+    v_fixed.zoom(zoom);
+    v_adaptive.zoom(zoom);
+    v_fixed.frame(d);
+    v_adaptive.frame(d);
+
+    auto large = 280 * zoom;
+    std::cout << "zoom " << std::setw(3) << zoom << ": vertices " << std::setw(8)
+              << fake_fixed.vertices() << " fixed, " << std::setw(8) << fake_adaptive.vertices()
+              << " adaptive; largest circle off by " << std::setprecision(3)
+              << Tessellator::error(large, 30) << " px fixed, "
+              << Tessellator::error(large, adaptive.unit(large).size()) << " px adaptive\n";
+
+    ok = ok && fake_adaptive.vertices() < fake_fixed.vertices() / 2;
+  }
+
+  // Circles under and over a rectangle: three draws, in that order.
+  Drawing layers;
+  layers.emplace_back<Circle>(10.f);
+  layers.emplace_back<Rectangle>(V2f(20, 20));
+  layers.emplace_back<Circle>(5.f);
+  FakeTarget fake_layers;
+  Viewer<FakeTarget>(fake_layers, adaptive).frame(layers);
+  std::cout << "circle, rectangle, circle: " << fake_layers.draws() << " draws\n";
+  ok = ok && fake_layers.draws() == 3 && adaptive.count(1e7f) == 1024;
+
+  if (argc > 1 && std::string(argv[1]) == "--headless")
+    return ok ? 0 : 1;
+
+
+  Window window(800, 800, "visitor");
+  Viewer<Window> viewer(window, adaptive);
+  viewer.show(d);
+
+  return 0;
+}
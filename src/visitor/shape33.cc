@@ -0,0 +1,483 @@
+/*
+clang++ -std=c++20 -O2 -pthread shape33.cc \
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <thread>
+#include <chrono>
+#include <charconv>
+
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius) : m_x(x), m_y(y), m_radius(radius) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_radius; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len) : m_x(x), m_y(y), m_len(len) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  int getSize() const { return m_len; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h) : m_x(x), m_y(y), m_w(w), m_h(h) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+};
+
+//=========================================================
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+//=========================================================
+class Drawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::size_t size() const { return m_shape.size(); }
+
+  auto begin() const { return m_shape.begin(); }
+  auto end() const { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<Shape> m_shape;
+};
+
+
+
+//=========================================================
+// Pretty is the output of the earlier examples: indented, and with a bare
+// "drawing": [...] member at the top, which is not a JSON document on its
+// own.
+//
+// Compact is one JSON document without whitespace. Each shape is an object
+// with one member, named after its type: {"drawing":[{"circle":{...}}]}.
+//
+// Lines writes one JSON document per line (NDJSON), for each shape and
+// sub-drawing, with its path: the index of the shape in each enclosing
+// drawing. A drawing's own line gives its size, so empty drawings are
+// kept, and comes before the lines of its shapes:
+//
+//   {"path":[],"drawing":{"size":2}}
+//   {"path":[0],"circle":{"x":1,"y":2,"radius":3}}
+//   {"path":[1],"drawing":{"size":1}}
+//   {"path":[1,0],"triangle":{"x":4,"y":5,"len":6}}
+//
+// No line depends on another, so the output can be cut at any byte offset
+// and each part read on its own from the first line that starts in it.
+enum class Format { Pretty, Compact, Lines };
+
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os, Format format = Format::Pretty) : m_os(os), m_format(format) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+
+    begin("circle");
+    field("x", x, true);
+    field("y", y);
+    field("radius", s.getSize());
+    end();
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+
+    begin("triangle");
+    field("x", x, true);
+    field("y", y);
+    field("len", s.getSize());
+    end();
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    begin("rectangle");
+    field("x", x, true);
+    field("y", y);
+    field("w", w);
+    field("h", h);
+    end();
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(const Drawing &d)
+  {
+    if (m_format == Format::Lines)
+    {
+      begin("drawing");
+      field("size", d.size(), true);
+      end();
+
+      m_path.push_back(0);
+      for (auto &s : d)
+      {
+        std::visit(*this, s);
+        ++m_path.back();
+      }
+      m_path.pop_back();
+      return;
+    }
+
+    const char *separator = m_format == Format::Pretty ? ",\n" : ",";
+
+    m_os << (m_format == Format::Pretty ? "\"drawing\": [\n" : "{\"drawing\":[");
+    for (auto it = d.begin(); it != d.end(); ++it)
+    {
+      if (it != d.begin())
+        m_os << separator;
+      std::visit(*this, *it);
+    }
+    m_os << (m_format == Format::Pretty ? "]\n" : "]}");
+  }
+
+//---------------------------------------------------------
+private:
+  void begin(const char *name)
+  {
+    switch (m_format)
+    {
+      case Format::Pretty: m_os << '"' << name << "\": {\n"; break;
+      case Format::Compact: m_os << "{\"" << name << "\":{"; break;
+      case Format::Lines:
+        m_os << "{\"path\":[";
+        for (std::size_t i = 0; i < m_path.size(); ++i)
+          m_os << (i ? "," : "") << m_path[i];
+        m_os << "],\"" << name << "\":{";
+      break;
+    }
+  }
+
+  template<typename T>
+  void field(const char *name, T value, bool first = false)
+  {
+    if (m_format == Format::Pretty)
+      m_os << (first ? "" : ",\n") << "  \"" << name << "\": " << value;
+    else
+      m_os << (first ? "" : ",") << '"' << name << "\":" << value;
+  }
+
+  void end()
+  {
+    switch (m_format)
+    {
+      case Format::Pretty: m_os << "\n}"; break;
+      case Format::Compact: m_os << "}}"; break;
+      case Format::Lines: m_os << "}}\n"; break;
+    }
+  }
+
+  std::ostream &m_os;
+  Format m_format;
+  std::vector<std::size_t> m_path;
+};
+
+
+
+//=========================================================
+// Checks that text is one JSON document, of the kind written above:
+// objects, arrays, strings without escapes and integers.
+class Validate {
+public:
+
+  Validate(std::string_view text) : m_text(text) {}
+
+  bool operator()() { return value() && m_at == m_text.size(); }
+
+//---------------------------------------------------------
+private:
+  bool eat(char c) { return m_at < m_text.size() && m_text[m_at] == c && ++m_at; }
+
+  bool value()
+  {
+    if (eat('{'))
+    {
+      if (eat('}'))
+        return true;
+      do
+        if (!string() || !eat(':') || !value())
+          return false;
+      while (eat(','));
+      return eat('}');
+    }
+    if (eat('['))
+    {
+      if (eat(']'))
+        return true;
+      do
+        if (!value())
+          return false;
+      while (eat(','));
+      return eat(']');
+    }
+    if (m_at < m_text.size() && m_text[m_at] == '"')
+      return string();
+
+    auto from = m_at;
+    eat('-');
+    while (m_at < m_text.size() && m_text[m_at] >= '0' && m_text[m_at] <= '9')
+      ++m_at;
+    return m_at > from && m_text[m_at - 1] != '-';
+  }
+
+  bool string()
+  {
+    if (!eat('"'))
+      return false;
+    auto end = m_text.find_first_of("\"\\", m_at);
+    if (end == m_text.npos || m_text[end] != '"')
+      return false;
+    m_at = end + 1;
+    return true;
+  }
+
+  std::string_view m_text;
+  std::size_t m_at = 0;
+};
+
+
+
+//=========================================================
+// What a downstream tool might take out of the output: how many shapes of
+// each type, and the sum of their x.
+struct Totals {
+  std::size_t shapes[4] = {};
+  long long x = 0;
+  bool valid = true;
+
+  Totals &operator+=(const Totals &t)
+  {
+    for (int i = 0; i < 4; ++i)
+      shapes[i] += t.shapes[i];
+    x += t.x;
+    valid = valid && t.valid;
+    return *this;
+  }
+
+  bool operator==(const Totals &) const = default;
+};
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The same from the drawing.
+void totals(const Drawing &d, Totals &t)
+{
+  ++t.shapes[3];
+  for (auto &s : d)
+    std::visit([&](auto &shape) {
+      if constexpr (std::is_same_v<std::decay_t<decltype(shape)>, Drawing>)
+        totals(shape, t);
+      else
+      {
+        ++t.shapes[s.index()];
+        t.x += std::get<0>(shape.getPosition());
+      }
+    }, s);
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// Reads the lines of NDJSON output that start in [from, to). A part that
+// does not start at 0 skips to the end of the line it starts in: that line
+// belongs to the part before. The last line need not end in a newline.
+Totals ingest(std::string_view text, std::size_t from, std::size_t to)
+{
+  const char *name[] = { "circle", "triangle", "rectangle", "drawing" };
+
+  Totals t;
+  std::size_t at = 0;
+  if (from && (at = text.find('\n', from - 1)) == text.npos)
+    return t;
+  at += from ? 1 : 0;
+
+  while (at < to)
+  {
+    auto end = text.find('\n', at);
+    bool last = end == text.npos;
+    if (last)
+      end = text.size();
+    auto line = text.substr(at, end - at);
+    at = end + 1;
+
+    t.valid = t.valid && Validate(line)();
+
+    // {"path":[...],"<name>":{"x":<x>,...
+    auto key = line.find("],\"") + 3;
+    auto type = line.substr(key, line.find('"', key) - key);
+    for (int i = 0; i < 4; ++i)
+      if (type == name[i])
+      {
+        ++t.shapes[i];
+        if (i < 3)
+        {
+          long long x = 0;
+          auto p = line.data() + key + type.size() + 7;
+          std::from_chars(p, line.data() + line.size(), x);
+          t.x += x;
+        }
+      }
+
+    if (last)
+      break;
+  }
+  return t;
+}
+
+// Splits the text into one part per thread, at whatever byte the split
+// falls on.
+Totals ingest(std::string_view text, int threads)
+{
+  std::vector<Totals> part(threads);
+  {
+    std::vector<std::jthread> readers;
+    for (int i = 0; i < threads; ++i)
+      readers.emplace_back([&, i] {
+        part[i] = ingest(text, text.size() * i / threads, text.size() * (i + 1) / threads);
+      });
+  }
+
+  Totals t;
+  for (auto &p : part)
+    t += p;
+  return t;
+}
+
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename F>
+double millis(F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Whether the output is JSON: one document, or one on every line.
+bool valid(std::string_view text, Format format)
+{
+  return format == Format::Lines ? ingest(text, 0, text.size()).valid : Validate(text)();
+}
+
+std::string write(const Drawing &d, Format format)
+{
+  std::ostringstream os;
+  ToJSON json(os, format);
+  json(d);
+  return os.str();
+}
+
+
+//=========================================================
+int main()
+{
+  // A small drawing in each format.
+  Drawing small;
+  small.add<Circle>(1, 2, 3);
+  small.add<Drawing>().add<Triangle>(4, 5, 6);
+  small.add<Rectangle>(7, 8, 9, 10);
+
+  for (auto format : {Format::Pretty, Format::Compact, Format::Lines})
+  {
+    auto text = write(small, format);
+    std::cout << text << (format == Format::Compact ? "\n" : "")
+              << "valid JSON: " << std::boolalpha << valid(text, format) << "\n\n";
+  }
+
+  // 1000 sub-drawings of 1000 shapes, some nested one level further.
+  Drawing d;
+  for (int i = 0; i < 1000; ++i)
+  {
+    auto &sub = d.add<Drawing>();
+    for (int j = 0; j < 1000; ++j)
+      switch (j % 4)
+      {
+        case 0: sub.add<Circle>(i, j, 5); break;
+        case 1: sub.add<Triangle>(i, j, 7); break;
+        case 2: sub.add<Rectangle>(i, j, 3, 4); break;
+        case 3: sub.add<Drawing>().add<Circle>(j, i, 1); break;
+      }
+  }
+
+  std::string text;
+  for (auto [format, what] : {std::pair(Format::Pretty, "pretty"),
+    std::pair(Format::Compact, "compact"), std::pair(Format::Lines, "lines")})
+  {
+    auto ms = millis([&] { text = write(d, format); });
+    std::cout << std::left << std::setw(8) << what << std::right << std::setw(10)
+              << text.size() << " bytes in " << std::fixed << std::setprecision(1)
+              << std::setw(6) << ms << " ms, valid JSON: " << valid(text, format) << '\n';
+  }
+
+  // The NDJSON read back in parts, split at arbitrary offsets.
+  Totals expected;
+  totals(d, expected);
+
+  std::cout << '\n' << std::thread::hardware_concurrency() << " hardware threads\n";
+  for (int threads : {1, 2, 4, 8})
+  {
+    Totals t;
+    auto ms = millis([&] { t = ingest(text, threads); });
+    std::cout << threads << " parts: " << std::setw(6) << ms << " ms, "
+              << t.shapes[0] + t.shapes[1] + t.shapes[2] + t.shapes[3]
+              << " lines, every line valid: " << t.valid
+              << ", same totals as the drawing: " << (t == expected) << '\n';
+  }
+
+  // NDJSON may leave out the last newline.
+  text.pop_back();
+  std::cout << "without the last newline, 4 parts: same totals as the drawing: "
+            << (ingest(text, 4) == expected) << '\n';
+
+  return 0;
+}
@@ -88,7 +88,7 @@ public:
 
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   template<typename T, typename... A>
-  auto &add(A... a)
+  auto &add(A&&... a)
   {
     auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
     return std::get<T>(tmp);
@@ -42,13 +42,16 @@ public:
   
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   template<typename T, typename... A>
-  auto &add(A... a)
+  auto &add(A&&... a)
   {
     auto &tmp = m_shape.emplace_back(std::in_place_type<T>,
       std::forward<A>(a)...);
     return std::get<T>(tmp);
   }
 
+  // Growing the vector copies every shape: sf::Shape has no move constructor.
+  void reserve(std::size_t n) { m_shape.reserve(n); }
+
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   auto begin() { return m_shape.begin(); }
   auto begin() const { return m_shape.begin(); }
@@ -27,13 +27,16 @@ public:
   
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   template<typename T, typename... A>
-  auto &emplace_back(A... a)
+  auto &emplace_back(A&&... a)
   {
     auto &tmp = m_composite.emplace_back(std::in_place_type<T>,
       std::forward<A>(a)...);
     return std::get<T>(tmp);
   }
 
+  // Growing the vector copies every shape: sf::Shape has no move constructor.
+  void reserve(std::size_t n) { m_composite.reserve(n); }
+
   //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
   template <typename T>
   void accept(T &visitor)
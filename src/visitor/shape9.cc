@@ -0,0 +1,460 @@
+/*
+clang++ -std=c++20 -O2 shape9.cc \
+*/
+
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <variant>
+#include <optional>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <cstdint>
+
+
+//=========================================================
+using Color = std::uint32_t;
+
+//=========================================================
+class Circle {
+public:
+
+  Circle(int x, int y, int radius, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_radius(radius), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  void setPosition(int x, int y) { m_x = x; m_y = y; }
+  int getSize() const { return m_radius; }
+  Color getFillColor() const { return m_fill; }
+
+  bool operator==(const Circle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_radius;
+  Color m_fill;
+};
+
+//=========================================================
+class Triangle {
+public:
+
+  Triangle(int x, int y, int len, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_len(len), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  void setPosition(int x, int y) { m_x = x; m_y = y; }
+  int getSize() const { return m_len; }
+  Color getFillColor() const { return m_fill; }
+
+  bool operator==(const Triangle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_len;
+  Color m_fill;
+};
+
+
+//=========================================================
+class Rectangle {
+public:
+
+  Rectangle(int x, int y, int w, int h, Color fill = 0xffffffff)
+    : m_x(x), m_y(y), m_w(w), m_h(h), m_fill(fill) {}
+
+  std::tuple<int, int> getPosition() const { return {m_x, m_y}; }
+  void setPosition(int x, int y) { m_x = x; m_y = y; }
+  std::tuple<int, int> getSize() const { return {m_w, m_h}; }
+  Color getFillColor() const { return m_fill; }
+
+  bool operator==(const Rectangle &) const = default;
+
+//---------------------------------------------------------
+private:
+  int m_x, m_y, m_w, m_h;
+  Color m_fill;
+};
+
+
+//=========================================================
+// The shape6 Drawing: every shape is stored in full.
+class PlainDrawing;
+using PlainShape = std::variant<Circle, Triangle, Rectangle, PlainDrawing>;
+
+class PlainDrawing {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T, typename... A>
+  auto &add(A&&... a)
+  {
+    auto &tmp = m_shape.emplace_back(std::in_place_type<T>, std::forward<A>(a)...);
+    return std::get<T>(tmp);
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::size_t memory() const
+  {
+    std::size_t n = m_shape.capacity() * sizeof(PlainShape);
+    for (auto &s : m_shape)
+      if (auto d = std::get_if<PlainDrawing>(&s)) n += d->memory();
+    return n;
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  auto begin() { return m_shape.begin(); }
+  auto end() { return m_shape.end(); }
+
+//---------------------------------------------------------
+private:
+  std::vector<PlainShape> m_shape;
+};
+
+
+
+//=========================================================
+// The flyweight factory. Each distinct (type, size, fill) is stored once,
+// with its position zeroed, and is referred to by a dense id.
+using Leaf = std::variant<Circle, Triangle, Rectangle>;
+
+struct LeafHash {
+  std::size_t operator()(const Leaf &l) const
+  {
+    auto mix = [](std::size_t k, std::size_t v) { return k * 1000003 ^ v; };
+
+    return std::visit([&](auto &s) {
+      auto k = mix(l.index(), s.getFillColor());
+      if constexpr (std::is_same_v<std::decay_t<decltype(s)>, Rectangle>)
+      {
+        auto [w, h] = s.getSize();
+        return mix(mix(k, w), h);
+      }
+      else
+        return mix(k, s.getSize());
+    }, l);
+  }
+};
+
+class ShapePool {
+public:
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  template<typename T>
+  std::uint32_t intern(T s)
+  {
+    s.setPosition(0, 0);
+    auto [it, inserted] = m_id.try_emplace(Leaf(s), m_leaf.size());
+    if (inserted)
+      m_leaf.push_back(s);
+    return it->second;
+  }
+
+  const Leaf &operator[](std::uint32_t id) const { return m_leaf[id]; }
+  std::size_t size() const { return m_leaf.size(); }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  std::size_t memory() const
+  {
+    // leaf table + the hash map's nodes (key, id, next) and buckets.
+    return m_leaf.capacity() * sizeof(Leaf)
+      + m_id.size() * (sizeof(Leaf) + 2 * sizeof(void*))
+      + m_id.bucket_count() * sizeof(void*);
+  }
+
+//---------------------------------------------------------
+private:
+  std::vector<Leaf> m_leaf;
+  std::unordered_map<Leaf, std::uint32_t, LeafHash> m_id;
+};
+
+
+//=========================================================
+// The extrinsic state of a shape: where it is and which pooled shape it is.
+struct Instance {
+  static constexpr std::uint32_t is_drawing = 0x80000000;
+
+  std::int32_t x, y;
+  std::uint32_t id;   // pool id, or sub-drawing index if is_drawing is set
+};
+
+struct DrawingNode {
+  std::vector<Instance> instance;
+  std::vector<std::unique_ptr<DrawingNode>> child;
+
+  std::size_t memory() const
+  {
+    std::size_t n = sizeof(DrawingNode) + instance.capacity() * sizeof(Instance)
+      + child.capacity() * sizeof(child[0]);
+    for (auto &c : child) n += c->memory();
+    return n;
+  }
+};
+
+
+//=========================================================
+// A Drawing is a cheap handle to a node in a flyweight document.
+// Iterating it resolves each instance into an ordinary Shape, so
+// existing visitors work unchanged.
+class Drawing;
+using Shape = std::variant<Circle, Triangle, Rectangle, Drawing>;
+
+class Drawing {
+public:
+
+  Drawing(DrawingNode &node, ShapePool &pool) : m_node(&node), m_pool(&pool) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  // Adding a shape stores 12 bytes; the shape itself is returned by value.
+  template<typename T, typename... A>
+  auto add(A&&... a)
+  {
+    if constexpr (std::is_same_v<T, Drawing>)
+    {
+      auto id = static_cast<std::uint32_t>(m_node->child.size());
+      auto &node = *m_node->child.emplace_back(std::make_unique<DrawingNode>());
+      m_node->instance.push_back({0, 0, id | Instance::is_drawing});
+      return Drawing(node, *m_pool);
+    }
+    else
+    {
+      T s(std::forward<A>(a)...);
+      auto [x, y] = s.getPosition();
+      m_node->instance.push_back({x, y, m_pool->intern(s)});
+      return s;
+    }
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  class iterator;
+  iterator begin() const;
+  iterator end() const;
+
+//---------------------------------------------------------
+private:
+  DrawingNode *m_node;
+  ShapePool *m_pool;
+};
+
+//=========================================================
+// Resolves the current instance into a Shape it owns, so that
+// 'for (auto &s : d)' works as it does for the shape6 Drawing.
+class Drawing::iterator {
+public:
+
+  iterator(const Drawing &d, std::size_t i)
+    : m_node(d.m_node), m_pool(d.m_pool), m_i(i) {}
+
+  Shape &operator*() { return m_current.emplace(resolve()); }
+  iterator &operator++() { ++m_i; return *this; }
+  bool operator!=(const iterator &o) const { return m_i != o.m_i; }
+
+//---------------------------------------------------------
+private:
+  Shape resolve() const
+  {
+    auto &in = m_node->instance[m_i];
+    if (in.id & Instance::is_drawing)
+      return Drawing(*m_node->child[in.id & ~Instance::is_drawing], *m_pool);
+
+    return std::visit([&](auto s) -> Shape {
+      s.setPosition(in.x, in.y);
+      return s;
+    }, (*m_pool)[in.id]);
+  }
+
+  DrawingNode *m_node;
+  ShapePool *m_pool;
+  std::size_t m_i;
+  std::optional<Shape> m_current;
+};
+
+inline Drawing::iterator Drawing::begin() const { return {*this, 0}; }
+inline Drawing::iterator Drawing::end() const
+{
+  return {*this, m_node->instance.size()};
+}
+
+
+//=========================================================
+class Document {
+public:
+
+  Drawing root() { return Drawing(m_root, m_pool); }
+  const ShapePool &pool() const { return m_pool; }
+
+  std::size_t memory() const { return m_root.memory() + m_pool.memory(); }
+
+//---------------------------------------------------------
+private:
+  DrawingNode m_root;
+  ShapePool m_pool;
+};
+
+
+
+//=========================================================
+class ToJSON {
+public:
+
+  ToJSON(std::ostream &os) : m_os(os) {}
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Circle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto radius = s.getSize();
+
+    m_os << "\"circle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"radius\": " << radius << ",\n"
+         << "  \"fill\": " << s.getFillColor() << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Triangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto len = s.getSize();
+
+    m_os << "\"triangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"len\": " << len << ",\n"
+         << "  \"fill\": " << s.getFillColor() << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Rectangle &s)
+  {
+    auto [x,y] = s.getPosition();
+    auto [w, h] = s.getSize();
+
+    m_os << "\"rectangle\": {\n"
+         << "  \"x\": " << x << ",\n"
+         << "  \"y\": " << y << ",\n"
+         << "  \"w\": " << w << ",\n"
+         << "  \"h\": " << h << ",\n"
+         << "  \"fill\": " << s.getFillColor() << "\n}";
+  }
+
+  //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+  void operator()(Drawing &d) { list(d); }
+  void operator()(PlainDrawing &d) { list(d); }
+
+//---------------------------------------------------------
+private:
+  template<typename D>
+  void list(D &d)
+  {
+    const char *p = "";
+    const char *postfix = ",\n";
+
+    m_os << "\"drawing\": [\n";
+    for (auto &s : d)
+    {
+      m_os << p;
+      std::visit(*this, s);
+      p = postfix;
+    }
+    m_os << "]\n";
+  }
+
+  std::ostream &m_os;
+};
+
+
+//=========================================================
+// Builds the same generated drawing into both representations:
+// n shapes drawn from a small set of sizes and fills, grouped into
+// sub-drawings of 1000 shapes each.
+template<typename D>
+void generate(D &&d, int n)
+{
+  using Sub = std::remove_cvref_t<D>;
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> pos(0, 4000), kind(0, 15);
+  const Color fill[] = { 0xff0000ff, 0x00ff00ff, 0x0000ffff, 0xffff00ff };
+
+  for (int i = 0; i < n; i += 1000)
+  {
+    auto &&sub = d.template add<Sub>();
+
+    for (int j = i; j < i + 1000 && j < n; ++j)
+    {
+      int k = kind(rng);
+      int x = pos(rng), y = pos(rng);
+      switch (k % 3)
+      {
+        case 0: sub.template add<Circle>(x, y, 10 + k, fill[k % 4]); break;
+        case 1: sub.template add<Triangle>(x, y, 20 + k, fill[k % 4]); break;
+        case 2: sub.template add<Rectangle>(x, y, 25, 50, fill[k % 4]); break;
+      }
+    }
+  }
+}
+
+//~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+template<typename D>
+std::pair<double, std::string> serialize(D &d)
+{
+  std::ostringstream os;
+  auto t0 = std::chrono::steady_clock::now();
+  ToJSON json(os);
+  json(d);
+  std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - t0;
+  return {ms.count(), os.str()};
+}
+
+
+//=========================================================
+int main()
+{
+  Document doc;
+  auto d = doc.root();
+  d.add<Circle>(100, 100, 50);
+
+  auto triangle = d.add<Triangle>(100, 200, 40);
+
+  auto d1 = d.add<Drawing>();
+  d1.add<Rectangle>(50, 50, 25, 50);
+  d1.add<Rectangle>(75, 75, 25, 50);
+
+  auto d2 = d1.add<Drawing>();
+  d2.add<Rectangle>(50, 150, 25, 60);
+  d2.add<Rectangle>(75, 175, 25, 60);
+
+  ToJSON json(std::cout);
+  json(d);
+  std::cout << "distinct shapes: " << doc.pool().size() << "\n\n";
+
+
+  // Benchmark
+  const int n = 1'000'000;
+
+  PlainDrawing plain;
+  generate(plain, n);
+
+  Document fly;
+  generate(fly.root(), n);
+
+  auto root = fly.root();
+  auto [plain_ms, plain_json] = serialize(plain);
+  auto [fly_ms, fly_json] = serialize(root);
+
+  std::cout << n << " shapes, " << fly.pool().size() << " distinct\n"
+            << "  plain:     " << plain.memory() << " bytes, "
+            << "toJSON " << plain_ms << " ms\n"
+            << "  flyweight: " << fly.memory() << " bytes, "
+            << "toJSON " << fly_ms << " ms\n"
+            << "  identical output: " << std::boolalpha
+            << (plain_json == fly_json) << '\n';
+
+  return 0;
+}